@@ -176,7 +176,7 @@ const config: Config = {
 
   // A map from regular expressions to paths to transformers
   transform: {
-    "\\.roc$": "./rocJestTransformer.ts"
+    "\\.roc$": "roc-esbuild/dist/jest-transformer.js"
   }
 
   // An array of regexp pattern strings that are matched against all source file paths, matched files will skip transformation
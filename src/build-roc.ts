@@ -72,6 +72,198 @@ const ccTargetFromRocTarget = (rocTarget: string) => {
   }
 }
 
+// The `process.platform` and `process.arch` that an addon built for the given Roc target runs on
+// (or null for wasm32, which Node can't load as an addon).
+const nodePlatformFromRocTarget = (rocTarget: string): { platform: string; arch: string } | null => {
+  switch (rocTarget) {
+    case "macos-arm64":
+      return { platform: "darwin", arch: "arm64" }
+    case "macos-x64":
+      return { platform: "darwin", arch: "x64" }
+    case "linux-arm64":
+      return { platform: "linux", arch: "arm64" }
+    case "linux-x64":
+      return { platform: "linux", arch: "x64" }
+    case "linux-x32":
+      return { platform: "linux", arch: "ia32" }
+    case "windows-x64":
+      return { platform: "win32", arch: "x64" }
+    case "wasm32":
+      return null
+    case "":
+      return { platform: os.platform(), arch: os.arch() }
+    default:
+      throw `Unrecognized --target option for roc compiler: ${rocTarget}`
+  }
+}
+
+// Whether the given C compiler command is clang (which includes `zig cc`) as opposed to gcc.
+// They take different flags for profile-guided optimization.
+const ccIsClang = (cc: Array<string>): boolean => {
+  if (cc[0] === "zig") {
+    return true
+  }
+
+  const output = spawnSync(cc[0], cc.slice(1).concat(["--version"]))
+
+  return output.status === 0 && /clang/i.test(output.stdout.toString())
+}
+
+// Whether the given C compiler command can build with -flto, which e.g. gcc without the LTO plugin
+// installed (or with a linker that lacks it) can't. We check by linking a tiny shared library,
+// since a toolchain can compile with -flto and still fail at the link.
+const ccSupportsLto = (cc: Array<string>): boolean => {
+  const probeDir = fs.mkdtempSync(`${os.tmpdir()}${path.sep}`)
+  const output = spawnSync(
+    cc[0],
+    cc.slice(1).concat(["-flto", "-shared", "-fPIC", "-x", "c", "-o", path.join(probeDir, "lto-probe.so"), "-"]),
+    { input: "int roc_esbuild_lto_probe(void) { return 0; }\n" },
+  )
+
+  fs.rmSync(probeDir, { recursive: true, force: true })
+
+  if (output.status !== 0) {
+    console.warn(`roc-esbuild: ${cc.join(" ")} can't link with -flto, so building without link-time optimization.`)
+
+    return false
+  }
+
+  return true
+}
+
+// A build of the addon's C bridge for a particular CPU, which the generated shim loads instead
+// of the baseline addon when the CPU it's running on has all of the `requires` features
+// (as named in /proc/cpuinfo). `arch` is the `process.arch` it's for.
+type CpuVariant = { name: string; flags: Array<string>; requires: Array<string>; arch?: string }
+
+const x86_64_v2_features = ["cx16", "lahf_lm", "popcnt", "sse4_1", "sse4_2", "ssse3"]
+const x86_64_v3_features = x86_64_v2_features.concat(["avx", "avx2", "bmi1", "bmi2", "f16c", "fma", "abm", "movbe", "xsave"])
+const x86_64_v4_features = x86_64_v3_features.concat(["avx512f", "avx512bw", "avx512cd", "avx512dq", "avx512vl"])
+
+// The `cpuVariants` that can be given by name instead of spelling out their flags.
+const cpuVariantPresets: { [name: string]: CpuVariant } = {
+  "x86-64-v2": { name: "x86-64-v2", flags: ["-march=x86-64-v2"], requires: x86_64_v2_features, arch: "x64" },
+  "x86-64-v3": { name: "x86-64-v3", flags: ["-march=x86-64-v3"], requires: x86_64_v3_features, arch: "x64" },
+  "x86-64-v4": { name: "x86-64-v4", flags: ["-march=x86-64-v4"], requires: x86_64_v4_features, arch: "x64" },
+}
+
+const cpuVariantFromConfig = (variant: string | CpuVariant): CpuVariant => {
+  if (typeof variant !== "string") {
+    return variant
+  }
+
+  if (!cpuVariantPresets.hasOwnProperty(variant)) {
+    throw new Error(`Unrecognized cpuVariants entry: ${variant} (expected one of ${Object.keys(cpuVariantPresets).join(", ")}, or an object with name, flags, and requires)`)
+  }
+
+  return cpuVariantPresets[variant]
+}
+
+// The path of the addon built for the given CPU variant, alongside the baseline addon.
+const cpuVariantAddonPath = (addonPath: string, variant: CpuVariant) =>
+  addonPath.replace(/\.node$/, `.${variant.name}.node`)
+
+// The shared runtime addon's file name, which is also its soname (or install name on macOS).
+// Module addons record that name as a dependency, and the dynamic loader considers an
+// already-loaded library with that soname to satisfy it, whatever its file is called
+// (e.g. after esbuild adds a content hash to it).
+const sharedRuntimeFileName = "roc-esbuild-runtime.node"
+
+// The shared runtimes built so far by this process, keyed by everything that affects how
+// they get built, so that all the modules in one esbuild run share one runtime.
+const sharedRuntimes = new Map<string, string>()
+
+const buildSharedRuntime = (key: string, link: (outputPath: string) => void): string => {
+  let runtimePath = sharedRuntimes.get(key)
+
+  if (runtimePath === undefined) {
+    runtimePath = path.join(fs.mkdtempSync(`${os.tmpdir()}${path.sep}`), sharedRuntimeFileName)
+
+    link(runtimePath)
+    sharedRuntimes.set(key, runtimePath)
+  }
+
+  return runtimePath
+}
+
+// The Chrome trace events for the build steps of every module this process has built with the
+// `trace` option, by the trace file they go in, so that modules sharing a file all end up in it.
+const buildTraces = new Map<string, Array<object>>()
+
+// Microseconds on the clock that Node's own trace events use (as does the addon's tracing).
+const traceClockUs = (): number => {
+  const [seconds, nanoseconds] = process.hrtime()
+
+  return seconds * 1e6 + nanoseconds / 1e3
+}
+
+// Record a build step that ran from `start` (a traceClockUs()) until now in the given trace file,
+// rewriting the file so it's complete even if a later step throws.
+const traceBuildStep = (traceFile: string | null, name: string, start: number, args: object) => {
+  if (traceFile === null) {
+    return
+  }
+
+  const events = buildTraces.get(traceFile) || []
+
+  events.push({ name, cat: "roc-esbuild", ph: "X", ts: start, dur: traceClockUs() - start, pid: process.pid, tid: 0, args })
+  buildTraces.set(traceFile, events)
+  fs.writeFileSync(traceFile, JSON.stringify({ traceEvents: events }), "utf8")
+}
+
+// The size of a file, in bytes.
+const fileBytes = (filePath: string): number => fs.statSync(filePath).size
+
+// What a child Node process runs to evaluate a module's constants (see the `inlineConstants` option):
+// load the addon, call each constant's function, and print each value as a JavaScript literal, or
+// write it to a file next to the addon if it's a string or Uint8Array bigger than maxInlineBytes.
+const evaluateConstantsSource = `
+const fs = require("fs")
+const [addonPath, namesJson, maxInlineBytes, runtimePath] = process.argv.slice(1)
+
+// An addon built with the shared runtime needs it loaded first.
+if (runtimePath !== "") {
+  require(runtimePath)
+}
+
+const addon = require(addonPath)
+
+const literal = (value) => {
+  if (typeof value === "bigint") {
+    return value + "n"
+  } else if (typeof value === "number") {
+    return Object.is(value, -0) ? "-0" : String(value)
+  } else if (value === undefined) {
+    return "undefined"
+  } else if (value instanceof Uint8Array) {
+    // The addon returns a List U8 as a Buffer.
+    return "Buffer.from([" + value.join(",") + "])"
+  } else if (typeof value === "object" && value !== null) {
+    return "{ " + Object.entries(value).map(([key, field]) => JSON.stringify(key) + ": " + literal(field)).join(", ") + " }"
+  } else {
+    return JSON.stringify(value)
+  }
+}
+
+const constants = {}
+
+for (const name of JSON.parse(namesJson)) {
+  const value = addon[name]()
+  const bytes = typeof value === "string" ? Buffer.from(value) : value instanceof Uint8Array ? value : null
+
+  if (bytes !== null && bytes.length > Number(maxInlineBytes)) {
+    const asset = addonPath + "." + name + ".roc-constant"
+
+    fs.writeFileSync(asset, bytes)
+    constants[name] = { asset, type: typeof value === "string" ? "string" : "bytes" }
+  } else {
+    constants[name] = { literal: literal(value) }
+  }
+}
+
+process.stdout.write(JSON.stringify(constants))
+`
+
 const rocNotFoundErr = "roc-esbuild could not find its roc-lang dependency in either its node_modules or any parent node_modules. This means it could not find the `roc` binary it needs to execute!";
 
 function runRoc(args: Array<string>) {
@@ -104,13 +296,99 @@ function runRoc(args: Array<string>) {
 const buildRocFile = (
   rocFilePath: string,
   addonPath: string,
-  config: { cc: Array<string>; target: string; optimize: boolean },
+  config: {
+    cc: Array<string>
+    target: string
+    optimize: boolean
+    atomicRefcount: boolean
+    memoryLimit: number
+    mmapThreshold: number
+    hugePages: boolean
+    lto: boolean
+    pgo: { trainingScript: string; profdata?: string } | null
+    cpuVariants: Array<string | CpuVariant>
+    sharedRuntime: boolean
+    heapProfile: boolean | { sampleBytes: number }
+    memoize: { maxEntries: number; maxBytes?: number } | null
+    trace: boolean | { file?: string; events?: number }
+    sanitize: Array<string>
+    stackSize: number
+    inlineConstants: boolean | { maxInlineBytes?: number }
+  },
 ) => {
   // The C compiler to use - e.g. you can specify `["zig" "cc"]` here to use Zig instead of the defualt `cc`.
   const cc = config.hasOwnProperty("cc") ? config.cc : ["cc"]
   const target = config.hasOwnProperty("target") ? config.target : ""
   const optimize = config.hasOwnProperty("optimize") ? config.optimize : ""
+  // Use atomic refcount operations in the C bridge, and lock its allocator bookkeeping, for when
+  // Roc values are shared between threads.
+  const atomicRefcount = config.hasOwnProperty("atomicRefcount") ? config.atomicRefcount : false
+  // Link with link-time optimization, if the C compiler supports it (e.g. `zig cc` does).
+  const lto = (config.hasOwnProperty("lto") ? config.lto : false) && ccSupportsLto(cc)
+  // Profile-guided optimization: build an instrumented addon, run `trainingScript` with node,
+  // and rebuild the addon using the resulting profile. `profdata` is the llvm-profdata binary to
+  // merge clang's profiles with (by default, the one Xcode has on macOS, which isn't on the PATH).
+  const pgo = config.hasOwnProperty("pgo") ? config.pgo : null
+  // Additional builds of the C bridge for newer CPUs (e.g. "x86-64-v3"), best first. The shim picks
+  // the first one the CPU supports at load time, falling back on the baseline addon.
+  const cpuVariants = (config.hasOwnProperty("cpuVariants") ? config.cpuVariants : []).map(cpuVariantFromConfig)
+  // Link the bridge into one shared runtime addon, rather than into every module's addon.
+  const sharedRuntime = config.hasOwnProperty("sharedRuntime") ? config.sharedRuntime : false
+  // The default maximum number of bytes a single Roc call may have allocated at once (0 means unlimited).
+  // Calls that exceed it throw a RangeError. This can be changed at runtime with `setMemoryLimit`.
+  const memoryLimit = config.hasOwnProperty("memoryLimit") ? config.memoryLimit : 0
+  // Give Roc allocations of at least this many bytes their own pages from mmap, so they go back to the OS
+  // as soon as Roc frees them (0 means never). With `hugePages`, back them with transparent huge pages.
+  const mmapThreshold = config.hasOwnProperty("mmapThreshold") ? config.mmapThreshold : 0
+  const hugePages = config.hasOwnProperty("hugePages") ? config.hugePages : false
+  // Record a histogram of the sizes Roc allocates, for `getHeapProfile`. With `sampleBytes`, also record
+  // the native return address of roughly one allocation per that many bytes allocated.
+  const heapProfile = config.hasOwnProperty("heapProfile") ? config.heapProfile : false
+  const heapProfileSampleBytes = typeof heapProfile === "object" ? heapProfile.sampleBytes : 0
+  // Cache up to `maxEntries` of callRoc's answers (taking up at most `maxBytes`, 64MiB by default) by
+  // their argument's JSON, so that repeated arguments don't call Roc again. Only for a JSON mainForHost
+  // that doesn't return an Effect, as that one can't depend on anything but its argument.
+  const memoize = config.hasOwnProperty("memoize") ? config.memoize : null
+  // Write Chrome trace events for the build steps to `file` (by default, next to the .roc file with
+  // .trace.json on the end), and have callRoc record its phases into a ring buffer of `events`
+  // events (4096 by default) for `drainTraceEvents`.
+  const trace = config.hasOwnProperty("trace") ? config.trace : false
+  const traceFile =
+    trace === false ? null : (typeof trace === "object" && trace.file) || `${rocFilePath}${target === "" ? "" : "." + target}.trace.json`
+  const traceEvents = trace === false ? 0 : (typeof trace === "object" && trace.events) || 4096
+  const buildStarted = traceClockUs()
+  // Compile the bridge with these sanitizers (e.g. ["address", "undefined"]), to catch memory errors
+  // and leaks in soak tests. The addon then needs the sanitizer's runtime loaded before node starts,
+  // e.g. LD_PRELOAD=$(cc -print-file-name=libasan.so), and ASan needs ASAN_OPTIONS=handle_segv=0
+  // (and LSan suppressions for V8) so that Roc crashes still reach the bridge's own handlers.
+  const sanitize = config.hasOwnProperty("sanitize") ? config.sanitize : []
+  // Run Roc calls on a thread of their own with a stack of this many bytes (0 means on the calling
+  // thread), for Roc code that recurses deeper than Node's main thread stack allows. Overflowing
+  // it throws, like any other crash in Roc.
+  const stackSize = config.hasOwnProperty("stackSize") ? config.stackSize : 0
+  // Evaluate the platform's constants (entry points that aren't functions, e.g. lookup tables) at
+  // build time, so that the bundle has their values in it, and getting one doesn't load the addon.
+  // Strings and Uint8Arrays of more than `maxInlineBytes` (64KiB by default) go in a file of their
+  // own rather than in the bundle. This needs an addon that can be loaded on the current machine.
+  const inlineConstants = config.hasOwnProperty("inlineConstants") ? config.inlineConstants : false
+  const maxInlineBytes = (typeof inlineConstants === "object" && inlineConstants.maxInlineBytes) || 64 * 1024
+  // How long each step of the build took, in milliseconds, for the build report. Steps that run more
+  // than once (e.g. cc, for each CPU variant) add up.
+  const durationsMs: { [step: string]: number } = {}
+
+  // Run a build step, timing it (and tracing it, with the `trace` option).
+  const buildStep = <T>(name: string, args: object, step: () => T): T => {
+    const start = traceClockUs()
+
+    try {
+      return step()
+    } finally {
+      durationsMs[name] = (durationsMs[name] || 0) + (traceClockUs() - start) / 1000
+      traceBuildStep(traceFile, name, start, args)
+    }
+  }
 
+  const nodePlatform = nodePlatformFromRocTarget(target)
   const rocFileName = path.basename(rocFilePath)
   const rocFileDir = path.dirname(rocFilePath)
   const errors = []
@@ -127,7 +405,7 @@ const buildRocFile = (
   // some object binary here at this step, `node-gyp` (which `npm install`/`yarn install` run automatically, and there's
   // no way to disable it) will fail when trying to build the addon, because it will be looking for an object
   // binary that isn't there.
-  runRoc(
+  buildStep("roc build", { file: rocFilePath }, () => runRoc(
     [
       "build",
       target === "" ? "" : `--target=${target}`,
@@ -137,14 +415,64 @@ const buildRocFile = (
       rocBuildOutputFile,
       rocFilePath
     ].filter((part) => part !== ""),
-  )
+  ))
 
   // TODO this is only necessary until `roc glue` can be run on app modules; once that exists,
   // we should run glue on the app .roc file and this can go away.
   const rocPlatformMain = path.join(rocFileDir, "platform", "main.roc")
 
-  // Generate the C glue
-  runRoc(["glue", path.join(__dirname, "node-glue.roc"), rocFileDir, rocPlatformMain])
+  // Generate the C glue. For platforms that don't use JSON, this includes C (and TypeScript
+  // declarations) for calling each entry point with typed arguments.
+  const glueDir = path.join(rocBuildOutputDir, "glue")
+
+  buildStep("roc glue", { platform: rocPlatformMain }, () =>
+    runRoc(["glue", path.join(__dirname, "node-glue.roc"), glueDir, rocPlatformMain]))
+
+  const typedGluePath = path.join(glueDir, "node-glue.c")
+  const typedGlue = fs.existsSync(typedGluePath)
+  // The typed entry points, by the name the addon exports them as, and which of them are constants.
+  const entryPoints: Array<{ name: string; constant: boolean }> = typedGlue
+    ? JSON.parse(fs.readFileSync(path.join(glueDir, "node-glue.json"), "utf8")).entryPoints
+    : []
+  const callRocTypedefs = typedGlue
+    ? `// These call the platform's entry points (callRoc being mainForHost), converting
+// each argument to the Roc type it expects, and converting what Roc returns back.
+// 64- and 128-bit integers are bigints, and so are Decs, as their value times 10^18.
+//
+// If \`timeoutMs\` (wall-clock time) or \`cpuTimeoutMs\` (CPU time used by this thread)
+// is given, a call that runs longer than that is interrupted, and throws an Error
+// whose \`code\` is "ERR_ROC_TIMEOUT".
+${fs.readFileSync(path.join(glueDir, "node-glue.d.ts"), "utf8")}`
+    : `// Currently, this function takes whatever you pass it and serializes it to JSON
+// for Roc to consume, and then Roc's returned answer also gets serialized to JSON
+// before JSON.parse gets called on it to convert it back to a TS value.
+//
+// This is an "80-20 solution" to get us a lot of functionality without having to
+// wait for the nicer version to be implemented. The nicer version would not use
+// JSON as an intermediary, and this part would specify the exact TS types needed
+// to call the Roc function, based on the Roc function's actual types.
+//
+// If \`timeoutMs\` (wall-clock time) or \`cpuTimeoutMs\` (CPU time used by this thread)
+// is given, a call that runs longer than that is interrupted, and throws an Error
+// whose \`code\` is "ERR_ROC_TIMEOUT". (Where the OS has no per-thread timers, such as
+// on macOS, Roc can only be interrupted when it allocates.)
+//
+// If the platform's mainForHost returns an Effect, Roc can call the functions in
+// \`hostFunctions\` by name (through its hostCall effect) while it runs, passing them
+// JSON and getting JSON back. If one throws, so does callRoc.
+export function callRoc<T extends JsonValue, U extends JsonValue>(input: T, options?: CallRocOptions): U
+
+// For inputs too big to pass to callRoc at once. If the platform provides initForHost,
+// stepForHost, and doneForHost, this passes \`arg\` to initForHost (as JSON), each chunk of
+// \`source\` in turn to stepForHost along with the state so far, and resolves to what
+// doneForHost returns (as JSON) for the final state. Only one chunk at a time is in memory.
+// The options apply to each of those calls separately.
+export function streamRoc<T extends JsonValue, U extends JsonValue>(
+  source: AsyncIterable<Uint8Array | string> | Iterable<Uint8Array | string>,
+  arg: T,
+  options?: CallRocOptions,
+): Promise<U>
+`
 
   // Create the .d.ts file. By design, our glue should output the same .d.ts file regardless of sytem architecture.
   const typedefs =
@@ -161,15 +489,43 @@ interface JsonObject {
   [key: string]: JsonValue
 }
 
-// Currently, this function takes whatever you pass it and serializes it to JSON
-// for Roc to consume, and then Roc's returned answer also gets serialized to JSON
-// before JSON.parse gets called on it to convert it back to a TS value.
-//
-// This is an "80-20 solution" to get us a lot of functionality without having to
-// wait for the nicer version to be implemented. The nicer version would not use
-// JSON as an intermediary, and this part would specify the exact TS types needed
-// to call the Roc function, based on the Roc function's actual types.
-export function callRoc<T extends JsonValue, U extends JsonValue>(input: T): U
+${callRocTypedefs}
+export interface CallRocOptions {
+  timeoutMs?: number
+  cpuTimeoutMs?: number
+  hostFunctions?: { [name: string]: (arg: any) => JsonValue | void }
+}
+
+// Set the maximum number of bytes a single callRoc may have allocated at once.
+// A call that needs more than this throws a RangeError. 0 means unlimited.
+export function setMemoryLimit(bytes: number): void
+
+// What Roc has allocated that hasn't been freed yet (in bytes, and allocations),
+// and how many allocations it has ever made. Calls that don't leak leave the
+// live counts where they found them.
+export function getAllocatorStats(): { liveBytes: number; liveAllocations: number; totalAllocations: number }
+
+// What Roc has allocated since the last resetHeapProfile, as text: "pprof" is the
+// gperftools heap profile format that \`pprof\` reads, "collapsed" is one line per
+// allocation site for flame graph tools, and "sizes" is a histogram of allocation
+// sizes. These throw unless the addon was built with the \`heapProfile\` option.
+export function getHeapProfile(format?: "pprof" | "collapsed" | "sizes"): string
+export function resetHeapProfile(): void
+
+// How callRoc's cache of answers (see the \`memoize\` option) has done, and what it
+// holds. These are all 0 unless the addon was built with that option. clearMemo
+// empties the cache, but keeps counting.
+export function getMemoStats(): { hits: number; misses: number; evictions: number; entries: number; bytes: number }
+export function clearMemo(): void
+
+// The Chrome trace events ("X" events, with \`ts\` and \`dur\` in microseconds on the
+// same clock as Node's own trace events) for the phases of every call since the
+// last drainTraceEvents, and how many events the buffer had to drop because it
+// filled up first. This throws unless the addon was built with the \`trace\` option.
+export function drainTraceEvents(): {
+  events: Array<{ name: string; cat: string; ph: "X"; ts: number; dur: number; pid: number; tid: number }>
+  dropped: number
+}
   `
 
   fs.writeFileSync(rocFilePath + ".d.ts", typedefs, "utf8")
@@ -231,6 +587,8 @@ export function callRoc<T extends JsonValue, U extends JsonValue>(input: T): U
     // "deps/v8/include"
   ]
     .map((suffix) => "-I" + path.join(includeRoot, suffix))
+    // For node-to-roc.h, which the typed glue (generated outside this directory) includes.
+    .concat(["-I" + __dirname])
     .join(" ")
 
   const defines = [
@@ -250,7 +608,18 @@ export function callRoc<T extends JsonValue, U extends JsonValue>(input: T): U
     "OPENSSL_NO_PINSHARED",
     "OPENSSL_THREADS",
     "BUILDING_NODE_EXTENSION",
+    atomicRefcount ? "ROC_ATOMIC_REFCOUNT" : "",
+    memoryLimit > 0 ? `ROC_MEMORY_LIMIT=${Math.floor(memoryLimit)}` : "",
+    mmapThreshold > 0 ? `ROC_MMAP_THRESHOLD=${Math.floor(mmapThreshold)}` : "",
+    mmapThreshold > 0 && hugePages ? "ROC_HUGE_PAGES" : "",
+    heapProfile ? "ROC_HEAP_PROFILE" : "",
+    heapProfileSampleBytes > 0 ? `ROC_HEAP_PROFILE_SAMPLE_BYTES=${Math.floor(heapProfileSampleBytes)}` : "",
+    memoize !== null && memoize.maxEntries > 0 ? `ROC_MEMO_MAX_ENTRIES=${Math.floor(memoize.maxEntries)}` : "",
+    memoize !== null && memoize.maxBytes !== undefined ? `ROC_MEMO_MAX_BYTES=${Math.floor(memoize.maxBytes)}` : "",
+    traceEvents > 0 ? `ROC_TRACE_EVENTS=${Math.floor(traceEvents)}` : "",
+    stackSize > 0 ? `ROC_STACK_SIZE=${Math.floor(stackSize)}` : "",
   ]
+    .filter((flag) => flag !== "")
     .map((flag) => "-D'" + flag + "'")
     .join(" ")
 
@@ -261,43 +630,198 @@ export function callRoc<T extends JsonValue, U extends JsonValue>(input: T): U
     libraries.push("-lrt")
   }
 
-  const cmd = cc
-    .concat([
-      ccTarget === "" ? "" : ccTarget,
-      "-o",
-      addonPath,
+  // Compile the node <-> roc C bridge and statically link in the .o binary (produced by `roc`)
+  // into the .node addon binary. `extraFlags` are for build modes (like PGO) that need to link
+  // the same addon more than once with different flags.
+  const linkAddon = (extraFlags: Array<string>, outputPath: string = addonPath, inputs: Array<string> = addonInputs) => {
+    const cmd = cc
+      .concat([
+        ccTarget === "" ? "" : ccTarget,
+        "-o",
+        outputPath,
+        inputs,
+        defines,
+        includes,
+        "-fPIC",
+        "-pthread",
+        optimize ? "-O3" : "",
+        // This was in the original node-gyp build, but it generates a separate directory.
+        // (Maybe it also adds the symbols to the binary? Further investigation needed.)
+        // buildingForMac ? "-gdwarf-2" : "",
+
+        // Many roc hosts need aligned_alloc, which was added in macOS 10.15.
+        buildingForMac ? "-mmacosx-version-min=10.15" : "",
+        "-Wall",
+        "-Wextra",
+        "-Wendif-labels",
+        "-W",
+        "-Wno-unused-parameter",
+        buildingForMac ? "-fno-strict-aliasing" : "-fno-omit-frame-pointer",
+        buildingForMac ? "-Wl,-undefined,dynamic_lookup" : "",
+        lto ? "-flto" : "",
+        sanitize.length > 0 ? `-fsanitize=${sanitize.join(",")} -g` : "",
+        extraFlags,
+        libraries.join(" "),
+        buildingForLinux ? "-shared" : "",
+      ])
+      .flat()
+      .filter((part) => part !== "")
+      .join(" ")
+
+    buildStep("cc", { output: outputPath, flags: extraFlags }, () => execSync(cmd, { stdio: "inherit" }))
+  }
+
+  // With the shared runtime, this module's addon only contains its Roc code and the small
+  // node-to-roc-module.c, and is linked against a runtime addon built from node-to-roc.c,
+  // which has to be loaded first (as the generated shim does). The only rpath is the addon's own
+  // directory, for loading it directly with the runtime next to it; the runtime gets built in a
+  // temporary directory, which mustn't end up in shipped addons.
+  let runtimePath: string | null = null
+  // With typed glue, the generated C defines the module, rather than node-to-roc.c.
+  let addonInputs = typedGlue ? [rocBuildOutputFile, cGluePath, typedGluePath, "-DROC_ESBUILD_TYPED_GLUE"] : [rocBuildOutputFile, cGluePath]
+
+  if (sharedRuntime) {
+    if (pgo !== null) {
+      throw new Error("roc-esbuild does not support profile-guided optimization together with the sharedRuntime option. Remove one of them.")
+    }
+
+    runtimePath = buildSharedRuntime(JSON.stringify([cc, target, optimize, lto, sanitize, defines]), (outputPath: string) => {
+      const soname = path.basename(outputPath)
+
+      linkAddon(["-DROC_ESBUILD_RUNTIME", buildingForMac ? `-Wl,-install_name,@rpath/${soname}` : `-Wl,-soname,${soname}`], outputPath, [cGluePath])
+    })
+
+    addonInputs = [
       rocBuildOutputFile,
-      cGluePath,
-      defines,
-      includes,
-      "-fPIC",
-      "-pthread",
-      optimize ? "-O3" : "",
-      // This was in the original node-gyp build, but it generates a separate directory.
-      // (Maybe it also adds the symbols to the binary? Further investigation needed.)
-      // buildingForMac ? "-gdwarf-2" : "",
-
-      // Many roc hosts need aligned_alloc, which was added in macOS 10.15.
-      buildingForMac ? "-mmacosx-version-min=10.15" : "",
-      "-Wall",
-      "-Wextra",
-      "-Wendif-labels",
-      "-W",
-      "-Wno-unused-parameter",
-      buildingForMac ? "-fno-strict-aliasing" : "-fno-omit-frame-pointer",
-      buildingForMac ? "-Wl,-undefined,dynamic_lookup" : "",
-      libraries.join(" "),
-      buildingForLinux ? "-shared" : "",
-    ])
-    .flat()
-    .filter((part) => part !== "")
-    .join(" ")
+      typedGlue ? typedGluePath : path.join(__dirname, "node-to-roc-module.c"),
+      runtimePath,
+      buildingForMac ? "-Wl,-rpath,@loader_path" : "'-Wl,-rpath,$ORIGIN'",
+    ]
+  }
 
-  // Compile the node <-> roc C bridge and statically link in the .o binary (produced by `roc`)
-  // into the .node addon binary
-  execSync(cmd, { stdio: "inherit" })
+  // The flags to link with the profile from profile-guided optimization, if any.
+  let pgoUseFlags: Array<string> = []
+
+  if (pgo === null) {
+    linkAddon([])
+  } else {
+    // Profile-guided optimization happens in two phases: first build an instrumented addon
+    // and run the user's training script against it (which writes out profile data),
+    // then rebuild the addon using that profile.
+    if (target !== "") {
+      throw new Error("roc-esbuild can only do profile-guided optimization when building for the current machine, because it has to run the training script against the addon. Remove either the `pgo` or the `target` option.")
+    }
+
+    const profileDir = path.join(rocBuildOutputDir, "pgo")
+    const clang = ccIsClang(cc)
+
+    fs.mkdirSync(profileDir)
+
+    linkAddon(clang ? [`-fprofile-generate=${profileDir}`] : ["-fprofile-generate", `-fprofile-dir=${profileDir}`])
+
+    // The training script can get the instrumented addon's path from this env var.
+    const training = buildStep("pgo training", { script: pgo.trainingScript }, () =>
+      spawnSync(process.execPath, [path.resolve(pgo.trainingScript)], {
+        stdio: "inherit",
+        env: { ...process.env, ROC_ESBUILD_PGO_ADDON: addonPath },
+      }))
+
+    if (training.status !== 0) {
+      throw new Error(`The profile-guided optimization training script ${pgo.trainingScript} exited with status ${training.status}`)
+    }
+
+    if (clang) {
+      // clang writes raw profiles, which have to be merged into one before it can use them.
+      const profdata = path.join(profileDir, "default.profdata")
+      const rawProfiles = fs
+        .readdirSync(profileDir)
+        .filter((file: string) => file.endsWith(".profraw"))
+        .map((file: string) => path.join(profileDir, file))
+
+      buildStep("llvm-profdata merge", { output: profdata }, () =>
+        execSync([pgo.profdata || (os.platform() === "darwin" ? "xcrun llvm-profdata" : "llvm-profdata"), "merge", `-output=${profdata}`].concat(rawProfiles).join(" "), { stdio: "inherit" }))
+
+      pgoUseFlags = [`-fprofile-use=${profdata}`]
+    } else {
+      // gcc reads its .gcda files directly. Code the training script never reached gets no
+      // profile, which is fine, so don't warn about it.
+      pgoUseFlags = ["-fprofile-use", `-fprofile-dir=${profileDir}`, "-Wno-missing-profile"]
+    }
+  }
 
-  return { errors: [] }
+  // gcc looks up each object's .gcda by the path of the output it was linked into, so a variant
+  // linked under its own name would silently get no profile. Link those under the addon's name
+  // instead, so they use the same profile, and rename them afterwards (before the addon itself
+  // gets linked there).
+  const variantsNeedAddonPath = pgo !== null && !ccIsClang(cc)
+
+  // The Roc object is the same for every variant, since `roc build` doesn't take CPU flags;
+  // only the bridge gets compiled for the variant's CPU. Variants for other CPU architectures than
+  // the target's (e.g. x86-64-v3 when building for linux-arm64) don't apply.
+  const targetCpuVariants = cpuVariants.filter(
+    (variant: CpuVariant) => variant.arch === undefined || nodePlatform === null || variant.arch === nodePlatform.arch,
+  )
+  const variants = targetCpuVariants.map((variant: CpuVariant) => {
+    const variantPath = cpuVariantAddonPath(addonPath, variant)
+
+    if (variantsNeedAddonPath) {
+      linkAddon(variant.flags.concat(pgoUseFlags))
+      fs.renameSync(addonPath, variantPath)
+    } else {
+      linkAddon(variant.flags.concat(pgoUseFlags), variantPath)
+    }
+
+    return { path: variantPath, requires: variant.requires, arch: variant.arch }
+  })
+
+  if (pgo !== null) {
+    linkAddon(pgoUseFlags)
+  }
+
+  const constantNames = entryPoints.filter((entryPoint) => entryPoint.constant).map((entryPoint) => entryPoint.name)
+  const loadableHere = nodePlatform !== null && nodePlatform.platform === os.platform() && nodePlatform.arch === os.arch()
+  let constants: { [name: string]: { literal: string } | { asset: string; type: "string" | "bytes" } } | null = null
+
+  if (inlineConstants !== false && constantNames.length > 0 && loadableHere) {
+    const evaluation = buildStep("evaluate constants", { names: constantNames }, () =>
+      spawnSync(process.execPath, ["-e", evaluateConstantsSource, addonPath, JSON.stringify(constantNames), String(maxInlineBytes), runtimePath || ""], {
+        encoding: "utf8",
+        maxBuffer: Infinity,
+      }))
+
+    if (evaluation.status !== 0) {
+      throw new Error(`roc-esbuild couldn't evaluate the constants in ${rocFileName} at build time:\n${evaluation.stderr}`)
+    }
+
+    constants = JSON.parse(evaluation.stdout)
+  }
+
+  traceBuildStep(traceFile, `build ${rocFileName}`, buildStarted, { file: rocFilePath, output: addonPath })
+
+  // What the plugin's build report says about this module: how long it took to build (in total and
+  // by step), and how big the Roc object and each addon it produced came out, in bytes.
+  const report = {
+    file: rocFilePath,
+    target: targetSuffix,
+    addon: addonPath,
+    totalMs: (traceClockUs() - buildStarted) / 1000,
+    durationsMs,
+    objectBytes: fileBytes(rocBuildOutputFile),
+    addonBytes: fileBytes(addonPath),
+    variantBytes: Object.fromEntries(variants.map((variant: { path: string }) => [variant.path, fileBytes(variant.path)])),
+    runtimeBytes: runtimePath === null ? null : fileBytes(runtimePath),
+  }
+
+  return {
+    errors: [],
+    variants,
+    runtime: runtimePath,
+    report,
+    platform: nodePlatform === null ? null : nodePlatform.platform,
+    arch: nodePlatform === null ? null : nodePlatform.arch,
+    entryPoints,
+    constants,
+  }
 }
 
 module.exports = buildRocFile
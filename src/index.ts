@@ -5,17 +5,392 @@
 // 3. Copy the binary and its .d.ts type definitions into the appropriate directory
 
 import type { PluginBuild, Plugin } from "esbuild";
+import fs from "fs"
 import path from "path"
+import { Worker } from "worker_threads"
 
 const buildRocFile = require("./build-roc")
 const rocNodeFileNamespace = "roc-node-file"
 
-function roc(opts?: { cc?: Array<string>; target?: string, optimize?: boolean }) : Plugin {
+// The functions that init() in node-to-roc.c exports from every addon.
+const addonExports = ["callRoc", "setMemoryLimit", "getAllocatorStats", "getHeapProfile", "resetHeapProfile", "getMemoStats", "clearMemo", "drainTraceEvents"]
+
+// Names that the module addonShim generates needs for itself, so an entry point or constant can't
+// have them. (Its other top-level names start with $, which no Roc name can.)
+const shimReservedNames = ["streamRoc", "require", "module", "exports", "process", "console"]
+
+// A CPU-specific build of an addon (see `cpuVariants` in build-roc.ts).
+type AddonVariant = { path: string; requires: Array<string>; arch?: string }
+
+// A constant that buildRocFile evaluated (see `inlineConstants` in build-roc.ts): either a
+// JavaScript literal, or a file holding a string's or Uint8Array's bytes.
+type RocConstant = { literal: string } | { asset: string; type: "string" | "bytes" }
+
+// What buildRocFile returns: the addons it built for one target, and its build report.
+type RocBuild = {
+  errors: Array<any>
+  variants: Array<AddonVariant>
+  runtime: string | null
+  report: object
+  platform: string | null
+  arch: string | null
+  entryPoints: Array<{ name: string; constant: boolean }>
+  constants: { [name: string]: RocConstant } | null
+}
+
+// An addon built for one target, and the `process.platform` and `process.arch` it's for
+// (undefined when the plugin only builds one target, whose addon always gets loaded).
+type AddonBuild = { path: string; platform?: string; arch?: string; variants: Array<AddonVariant>; runtime: string | null }
+
+// Generate the module that esbuild bundles in place of a .roc file. It doesn't load the addon
+// until one of its functions is first called, so that merely importing a .roc module costs
+// nothing at startup (no dlopen, and no init() installing signal handlers) on code paths
+// that never call into it. Each load is recorded as a `performance` measure, and also
+// logged to stderr if the ROC_ESBUILD_LOG_LOAD_TIME environment variable is set.
+//
+// With the `targets` option, it loads the addon built for the platform and CPU architecture
+// it's running on (and throws if there isn't one).
+//
+// If there are CPU variants, the first one whose required CPU features are all present
+// (according to /proc/cpuinfo) gets loaded instead of the baseline addon.
+//
+// If the addon was built with the shared runtime, the runtime addon gets loaded first, so the
+// module addon's dependency on it resolves to that already-loaded copy.
+//
+// Constants that were evaluated at build time return their value without loading the addon at
+// all. Big ones are read from their file the first time they're needed.
+//
+// The "esm" format is for esbuild, whose file loader bundles the files the shim imports (the
+// addons, and big constants' files). The "cjs" format is for the Jest transformer, which loads
+// them from where they are.
+export function addonShim(
+  rocFilePath: string,
+  builds: Array<AddonBuild>,
+  entryPoints: Array<{ name: string }>,
+  constants: { [name: string]: RocConstant } | null,
+  format: "esm" | "cjs" = "esm",
+): string {
+  const evaluated = constants === null ? {} : constants
+  const functions = Array.from(new Set(addonExports.concat(entryPoints.map((entryPoint) => entryPoint.name))))
+  const exported = functions.concat(Object.keys(evaluated).filter((name) => !functions.includes(name)), ["streamRoc"])
+  const clashing = exported.slice(0, -1).filter((name) => shimReservedNames.includes(name))
+
+  if (clashing.length > 0) {
+    throw new Error(
+      `${path.basename(rocFilePath)} can't provide ${clashing.map((name) => `\`${name}\``).join(", ")} to JavaScript, because the module roc-esbuild generates for it uses ${clashing.length === 1 ? "that name" : "those names"} already. Rename ${clashing.length === 1 ? "it" : "them"} in the platform.`,
+    )
+  }
+  const exportKeyword = format === "esm" ? "export " : ""
+  const fileBinding = (name: string, filePath: string) =>
+    format === "esm" ? `import ${name} from ${JSON.stringify(filePath)}` : `const ${name} = ${JSON.stringify(filePath)}`
+  const exports = functions
+    .filter((fn) => !evaluated.hasOwnProperty(fn))
+    .map((fn) => `${exportKeyword}function ${fn}(...args) { return $load().${fn}(...args) }`)
+    .concat(
+      Object.entries(evaluated).map(([name, constant], index) =>
+        "literal" in constant
+          ? `${exportKeyword}function ${name}() { return ${constant.literal} }`
+          : `${fileBinding(`$constantPath${index}`, constant.asset)}
+let $constant${index}
+${exportKeyword}function ${name}() {
+  if ($constant${index} === undefined) {
+    $constant${index} = require("fs").readFileSync(require("path").resolve(__dirname, $constantPath${index}))
+  }
+
+  return ${constant.type === "string" ? `$constant${index}.toString("utf8")` : `Buffer.from($constant${index})`}
+}`,
+      ),
+    )
+    .join("\n")
+  const imports = builds
+    .map((build, index) =>
+      [fileBinding(`$addonPath${index}`, build.path)]
+        .concat(build.variants.map((variant, variantIndex) => fileBinding(`$variantPath${index}_${variantIndex}`, variant.path)))
+        .concat(build.runtime === null ? [] : [fileBinding(`$runtimePath${index}`, build.runtime)])
+        .join("\n"),
+    )
+    .join("\n")
+  const buildEntries = builds
+    .map((build, index) => {
+      const variantEntries = build.variants
+        .map((variant, variantIndex) => `      { path: $variantPath${index}_${variantIndex}, arch: ${JSON.stringify(variant.arch)}, requires: ${JSON.stringify(variant.requires)} },`)
+        .join("\n")
+
+      return `  {
+    platform: ${JSON.stringify(build.platform)},
+    arch: ${JSON.stringify(build.arch)},
+    path: $addonPath${index},
+    runtime: ${build.runtime === null ? "null" : `$runtimePath${index}`},
+    variants: [${variantEntries === "" ? "" : `\n${variantEntries}\n    `}],
+  },`
+    })
+    .join("\n")
+
+  return `
+${imports}
+${format === "esm" ? `import { performance as $performance } from "perf_hooks"` : `const { performance: $performance } = require("perf_hooks")`}
+
+const $rocFileName = ${JSON.stringify(path.basename(rocFilePath))}
+const $measureName = \`roc-esbuild load \${$rocFileName}\`
+const $builds = [
+${buildEntries}
+]
+let $addon
+
+function $chooseBuild() {
+  const build = $builds.find((build) =>
+    (build.platform === undefined || build.platform === process.platform) &&
+    (build.arch === undefined || build.arch === process.arch))
+
+  if (build === undefined) {
+    const built = $builds.map((build) => \`\${build.platform}-\${build.arch}\`).join(", ")
+
+    throw new Error(\`\${$rocFileName} was only built for \${built}, not \${process.platform}-\${process.arch}\`)
+  }
+
+  return build
+}
+
+// The CPU feature flags listed in /proc/cpuinfo ("flags" on x86, "Features" on ARM).
+// Elsewhere (e.g. on macOS) we can't tell, so only variants that require nothing apply.
+function $cpuFeatures() {
+  try {
+    const cpuinfo = require("fs").readFileSync("/proc/cpuinfo", "utf8")
+    const line = cpuinfo.split("\\n").find((line) => /^(flags|Features)\\s*:/.test(line))
+
+    return new Set(line === undefined ? [] : line.split(":")[1].trim().split(/\\s+/))
+  } catch (err) {
+    return new Set()
+  }
+}
+
+function $chooseAddonPath(build) {
+  if (build.variants.length === 0) {
+    return build.path
+  }
+
+  const features = $cpuFeatures()
+  const variant = build.variants.find((variant) =>
+    (variant.arch === undefined || variant.arch === process.arch) &&
+    variant.requires.every((feature) => features.has(feature)))
+
+  return variant === undefined ? build.path : variant.path
+}
+
+function $load() {
+  if ($addon === undefined) {
+    const start = $performance.now()
+    const build = $chooseBuild()
+
+    if (build.runtime !== null) {
+      require(build.runtime)
+    }
+
+    $addon = require($chooseAddonPath(build))
+
+    const end = $performance.now()
+
+    $performance.measure($measureName, { start, end })
+
+    if (process.env.ROC_ESBUILD_LOG_LOAD_TIME) {
+      console.error(\`\${$measureName} took \${(end - start).toFixed(3)}ms\`)
+    }
+  }
+
+  return $addon
+}
+
+${exports}
+
+// Feed each chunk of \`source\` (a Readable, or any iterable or async iterable of Uint8Arrays
+// or strings) to the platform's stepForHost in turn, starting from initForHost's state for
+// \`arg\`, and resolve to what doneForHost makes of the final state. If reading \`source\`
+// fails, the stream still gets finished (so Roc can free its state) before this rejects.
+${exportKeyword}async function streamRoc(source, arg, options) {
+  const addon = $load()
+
+  if (addon.startRocStream === undefined) {
+    throw new Error(\`\${$rocFileName}'s platform doesn't provide initForHost, stepForHost, and doneForHost, so it can't be streamed to\`)
+  }
+
+  const stream = addon.startRocStream(arg, options)
+
+  try {
+    for await (const chunk of source) {
+      if (typeof chunk !== "string" && !(chunk instanceof Uint8Array)) {
+        throw new TypeError(\`streamRoc expects its source to yield Uint8Arrays or strings, not \${typeof chunk}\`)
+      }
+
+      addon.stepRocStream(stream, typeof chunk === "string" ? Buffer.from(chunk) : chunk, options)
+    }
+  } catch (err) {
+    try {
+      addon.finishRocStream(stream, options)
+    } catch (finishErr) {
+      // The stream already crashed (which is probably what err is), or finishing it did.
+    }
+
+    throw err
+  }
+
+  return addon.finishRocStream(stream, options)
+}
+${format === "esm" ? "" : `\nmodule.exports = { ${exported.join(", ")} }\n`}`
+}
+
+// What each build worker runs: buildRocFile for every request it gets, one at a time.
+const buildWorkerSource = `
+const { parentPort, workerData } = require("worker_threads")
+
+// When running from src/ (e.g. under \`npm run dev\`), build-roc is TypeScript, and ts-node only
+// registered its hooks on the main thread.
+if (workerData.tsNodeModule !== null) {
+  require(workerData.tsNodeModule).register({ transpileOnly: true })
+}
+
+const buildRocFile = require(workerData.buildRocModule)
+
+parentPort.on("message", ({ id, rocFilePath, addonPath, config }) => {
+  try {
+    parentPort.postMessage({ id, build: buildRocFile(rocFilePath, addonPath, config) })
+  } catch (err) {
+    parentPort.postMessage({ id, error: err instanceof Error ? err.message : String(err) })
+  }
+})
+`
+
+// Start a worker thread to build .roc files for one target, and return a function that has it
+// build one. buildRocFile blocks until roc and cc finish, so giving each target its own worker
+// is what lets targets build concurrently. A target keeps its worker for as long as the plugin
+// is in use, so that (with the sharedRuntime option) all of its modules share one runtime.
+function buildWorker(): (rocFilePath: string, addonPath: string, config: object) => Promise<RocBuild> {
+  // build-roc.js next to this file in dist/, or build-roc.ts when running from src/, in which case
+  // the worker has to register ts-node to load it.
+  const buildRocModule = require.resolve("./build-roc")
+  const tsNodeModule = buildRocModule.endsWith(".ts") ? require.resolve("ts-node") : null
+  const worker = new Worker(buildWorkerSource, { eval: true, workerData: { buildRocModule, tsNodeModule } })
+  const pending = new Map<number, { resolve: (build: RocBuild) => void; reject: (err: Error) => void }>()
+  let nextId = 0
+
+  worker.on("message", ({ id, build, error }: { id: number; build?: RocBuild; error?: string }) => {
+    const request = pending.get(id)
+
+    if (request !== undefined) {
+      pending.delete(id)
+
+      if (pending.size === 0) {
+        worker.unref()
+      }
+
+      if (error === undefined) {
+        request.resolve(build as RocBuild)
+      } else {
+        request.reject(new Error(error))
+      }
+    }
+  })
+
+  worker.on("error", (err: Error) => {
+    pending.forEach((request) => request.reject(err))
+    pending.clear()
+  })
+
+  // Only keep the process alive for this worker while it's building something. (This has to come
+  // after adding the listeners, which ref it.)
+  worker.unref()
+
+  return (rocFilePath: string, addonPath: string, config: object) =>
+    new Promise((resolve, reject) => {
+      const id = nextId++
+
+      worker.ref()
+      pending.set(id, { resolve, reject })
+      worker.postMessage({ id, rocFilePath, addonPath, config })
+    })
+}
+
+type RocPluginOptions = {
+  cc?: Array<string>
+  target?: string
+  // Build for each of these Roc targets (e.g. ["linux-x64", "linux-arm64"]) at once, instead of
+  // just `target`. Each .roc module's shim loads whichever addon matches the machine it runs on.
+  targets?: Array<string>
+  optimize?: boolean
+  atomicRefcount?: boolean
+  memoryLimit?: number
+  mmapThreshold?: number
+  hugePages?: boolean
+  lto?: boolean
+  pgo?: { trainingScript: string; profdata?: string }
+  cpuVariants?: Array<string | { name: string; flags: Array<string>; requires: Array<string>; arch?: string }>
+  sharedRuntime?: boolean
+  heapProfile?: boolean | { sampleBytes: number }
+  memoize?: { maxEntries: number; maxBytes?: number }
+  trace?: boolean | { file?: string; events?: number }
+  sanitize?: Array<string>
+  stackSize?: number
+  inlineConstants?: boolean | { maxInlineBytes?: number }
+  // Where to write a JSON report of how long each .roc module took to build (by step) and how big
+  // its Roc object and addons are, at the end of every esbuild run. The report also goes in the
+  // metafile (as `roc`), when esbuild was asked for one.
+  report?: string
+}
+
+function roc(opts?: RocPluginOptions) : Plugin {
   const config = opts !== undefined ? opts : {}
+  const reportPath = opts !== undefined ? opts.report : undefined
+  const targets = opts !== undefined ? opts.targets : undefined
+  const inlineConstants = opts !== undefined ? opts.inlineConstants : undefined
+  // The build worker for each target, started when that target's first module gets built.
+  const buildWorkers = new Map<string, (rocFilePath: string, addonPath: string, config: object) => Promise<RocBuild>>()
+
+  // Build the .roc file for one of the `targets`, in that target's worker.
+  const buildForTarget = (target: string, rocFilePath: string, addonPath: string): Promise<RocBuild> => {
+    let build = buildWorkers.get(target)
+
+    if (build === undefined) {
+      build = buildWorker()
+      buildWorkers.set(target, build)
+    }
+
+    return build(rocFilePath, addonPath, { ...config, target })
+  }
+
+  // With `inlineConstants`, warn about a module whose constants couldn't be evaluated at build time
+  // (because it wasn't built for this machine), and so get computed when they're called instead.
+  const constantsWarnings = (
+    rocFilePath: string,
+    entryPoints: Array<{ name: string; constant: boolean }>,
+    constants: { [name: string]: RocConstant } | null,
+  ) =>
+    inlineConstants && constants === null && entryPoints.some((entryPoint) => entryPoint.constant)
+      ? [{ text: `The constants in ${path.basename(rocFilePath)} couldn't be evaluated at build time, because it wasn't built for ${process.platform}-${process.arch}. They'll be computed when they're called instead.` }]
+      : []
 
   return {
     name: "roc",
     setup(build: PluginBuild) {
+      // The build reports of the .roc modules built in the current esbuild run, in the order they
+      // finished building.
+      let reports: Array<object> = []
+
+      build.onStart(() => {
+        reports = []
+      })
+
+      build.onEnd((result) => {
+        const report = { modules: reports }
+
+        if (reportPath !== undefined) {
+          fs.writeFileSync(reportPath, JSON.stringify(report, null, 2) + "\n", "utf8")
+        }
+
+        if (result.metafile !== undefined) {
+          // esbuild's metafile has no place for this, but tools that read it ignore keys they don't know.
+          (result.metafile as any).roc = report
+        }
+      })
+
       // Resolve ".roc" files to a ".node" path with a namespace
       build.onResolve({ filter: /\.roc$/, namespace: "file" }, (args) => {
         return {
@@ -27,24 +402,52 @@ function roc(opts?: { cc?: Array<string>; target?: string, optimize?: boolean })
       // Files in the "node-file" virtual namespace call "require()" on the
       // path from esbuild of the ".node" file in the output directory.
       // Strategy adapted from https://github.com/evanw/esbuild/issues/1051#issuecomment-806325487
-      build.onLoad({ filter: /.*/, namespace: rocNodeFileNamespace }, (args) => {
+      build.onLoad({ filter: /.*/, namespace: rocNodeFileNamespace }, async (args) => {
         // Load ".roc" files, generate .d.ts files for them, compile and link them into native Node addons,
         // and tell esbuild how to bundle those addons.
         const rocFilePath = args.path.replace(/\.node$/, ".roc")
-        const { errors } = buildRocFile(rocFilePath, args.path, config) // TODO get `target` arg from esbuild config
+
+        if (targets === undefined) {
+          const { errors, variants, runtime, report, entryPoints, constants }: RocBuild = buildRocFile(rocFilePath, args.path, config) // TODO get `target` arg from esbuild config
+
+          reports.push(report)
+
+          return {
+            contents: addonShim(rocFilePath, [{ path: args.path, variants, runtime }], entryPoints, constants),
+            warnings: constantsWarnings(rocFilePath, entryPoints, constants),
+          }
+        }
+
+        // Every target builds at once, each into an addon with the target in its name.
+        const addonPaths = targets.map((target) => args.path.replace(/\.node$/, `.${target}.node`))
+        const builds = await Promise.all(targets.map((target, index) => buildForTarget(target, rocFilePath, addonPaths[index])))
+
+        builds.forEach((build) => reports.push(build.report))
+
+        // Constants are the same for every target, so any target that could evaluate them will do.
+        const evaluatedBuild = builds.find((build) => build.constants !== null)
+        const constants = evaluatedBuild === undefined ? null : evaluatedBuild.constants
 
         return {
-          contents: `
-          import path from ${JSON.stringify(args.path)}
-          module.exports = require(path)
-        `,
+          contents: addonShim(
+            rocFilePath,
+            // There's no loading a wasm32 build as an addon, so the shim leaves those out.
+            builds.flatMap((build, index) =>
+              build.platform === null || build.arch === null
+                ? []
+                : [{ path: addonPaths[index], platform: build.platform, arch: build.arch, variants: build.variants, runtime: build.runtime }],
+            ),
+            builds[0].entryPoints,
+            constants,
+          ),
+          warnings: constantsWarnings(rocFilePath, builds[0].entryPoints, constants),
         }
       })
 
-      // If a ".node" file is imported within a module in the "roc-node-file" namespace, put
+      // If a ".node" (or ".roc-constant") file is imported within a module in the "roc-node-file" namespace, put
       // it in the "file" namespace where esbuild's default loading behavior will handle
       // it. It is already an absolute path since we resolved it to one earlier.
-      build.onResolve({ filter: /\.node$/, namespace: rocNodeFileNamespace }, (args) => ({
+      build.onResolve({ filter: /\.(node|roc-constant)$/, namespace: rocNodeFileNamespace }, (args) => ({
         path: args.path,
         namespace: "file",
       }))
@@ -55,6 +458,9 @@ function roc(opts?: { cc?: Array<string>; target?: string, optimize?: boolean })
       opts.loader = opts.loader || {}
 
       opts.loader[".node"] = "file"
+
+      // The same goes for the files that hold big constants' values (see `inlineConstants`).
+      opts.loader[".roc-constant"] = "file"
     },
   }
 }
@@ -0,0 +1,224 @@
+// A Jest transformer for .roc files. Use it in jest.config.ts like so:
+//
+//     transform: {
+//       "\\.roc$": ["roc-esbuild/dist/jest-transformer.js", { optimize: false }],
+//     }
+//
+// where the (optional) object is the same config the esbuild plugin takes.
+//
+// Compiling Roc is by far the slowest part of transforming a .roc file, so this does it at
+// most once per version of the Roc sources (and config):
+//
+// 1. getCacheKey hashes the .roc files in the module's directory (including its platform)
+//    along with the config, so Jest's own cache skips unchanged modules entirely.
+// 2. Each addon gets written to its own path based on that hash, rather than every module
+//    sharing one `addon.node`, so an addon that's already been built never gets rebuilt.
+// 3. Builds hold a lock file (per directory, since `roc glue` and the .d.ts output write to
+//    the module's directory), so parallel Jest workers wait for one another's build instead
+//    of racing on the same files. A lock left behind by a worker that died gets taken over.
+//
+// The module is the same shim the esbuild plugin generates (in CommonJS), so it loads CPU
+// variants and the shared runtime, has inlined constants, and provides streamRoc. It gets
+// cached next to the addon, and written last, so it's only there once everything it loads is.
+
+const crypto = require("crypto")
+const fs = require("fs")
+const path = require("path")
+
+const buildRocFile = require("./build-roc")
+const { addonShim } = require("./index")
+const { version } = require("../package.json")
+
+// A lock file holds the PID of whoever created it, so a lock whose creator has died without
+// removing it can be taken over, no matter how long a build takes. One that's still empty after
+// this long had its creator die between creating it and writing to it.
+const staleEmptyLockMs = 10 * 1000
+
+// How long to wait between checks of whether another worker's lock has been released.
+const lockPollMs = 50
+
+type TransformOptions = {
+  config: { cacheDirectory: string }
+  transformerConfig?: object
+}
+
+const sha256 = (contents: string | Buffer) => crypto.createHash("sha256").update(contents).digest("hex")
+
+// Write a file such that nobody ever sees it partly written.
+const writeFileAtomically = (filePath: string, contents: string | Buffer) => {
+  const tmpPath = `${filePath}.${process.pid}.tmp`
+
+  fs.writeFileSync(tmpPath, contents)
+  fs.renameSync(tmpPath, filePath)
+}
+
+// All the .roc files a module could depend on: the ones in its directory and below (which
+// includes its platform/ directory), in a stable order.
+const rocSourcesIn = (dir: string): Array<string> =>
+  fs
+    .readdirSync(dir, { withFileTypes: true })
+    .sort((a: { name: string }, b: { name: string }) => (a.name < b.name ? -1 : a.name > b.name ? 1 : 0))
+    .flatMap((entry: { name: string; isDirectory: () => boolean; isFile: () => boolean }) => {
+      const entryPath = path.join(dir, entry.name)
+
+      if (entry.isDirectory()) {
+        return entry.name === "node_modules" || entry.name.startsWith(".") ? [] : rocSourcesIn(entryPath)
+      } else if (entry.isFile() && entry.name.endsWith(".roc")) {
+        return [entryPath]
+      } else {
+        return []
+      }
+    })
+
+const cacheKey = (rocFilePath: string, transformerConfig: object | undefined): string => {
+  const hash = crypto.createHash("sha256")
+
+  hash.update(version)
+  hash.update(JSON.stringify(transformerConfig || {}))
+  hash.update(rocFilePath)
+
+  for (const sourcePath of rocSourcesIn(path.dirname(rocFilePath))) {
+    hash.update(sourcePath)
+    hash.update(fs.readFileSync(sourcePath))
+  }
+
+  return hash.digest("hex")
+}
+
+const isAlive = (pid: number): boolean => {
+  try {
+    // Signal 0 doesn't send anything; it only checks that the process exists.
+    process.kill(pid, 0)
+
+    return true
+  } catch (err: any) {
+    // EPERM means it exists, but belongs to someone else.
+    return err.code !== "ESRCH"
+  }
+}
+
+const isStaleLock = (lockPath: string): boolean => {
+  const pid = parseInt(fs.readFileSync(lockPath, "utf8"), 10)
+
+  return isNaN(pid) ? Date.now() - fs.statSync(lockPath).mtimeMs > staleEmptyLockMs : !isAlive(pid)
+}
+
+// Block (this is a synchronous transformer) until we manage to create the lock file.
+const acquireLock = (lockPath: string) => {
+  const sleeper = new Int32Array(new SharedArrayBuffer(4))
+
+  for (;;) {
+    try {
+      const fd = fs.openSync(lockPath, "wx")
+
+      try {
+        fs.writeSync(fd, `${process.pid}`)
+      } finally {
+        fs.closeSync(fd)
+      }
+
+      return
+    } catch (err: any) {
+      if (err.code !== "EEXIST") {
+        throw err
+      }
+    }
+
+    try {
+      if (isStaleLock(lockPath)) {
+        fs.unlinkSync(lockPath)
+      }
+    } catch (err: any) {
+      // It's fine if the lock went away in the meantime; we'll try again.
+      if (err.code !== "ENOENT") {
+        throw err
+      }
+    }
+
+    Atomics.wait(sleeper, 0, 0, lockPollMs)
+  }
+}
+
+// Build the addon to a temporary path, so that nobody ever sees a partly-written one, and then
+// move it (along with its CPU variants, and the files of big constants, which are named after
+// it) into place. Return the shim that loads them.
+const buildShim = (sourcePath: string, addonPath: string, cacheDir: string, config: object): string => {
+  const tmpPath = `${addonPath}.${process.pid}.tmp.node`
+  const { variants, runtime, entryPoints, constants } = buildRocFile(sourcePath, tmpPath, config)
+
+  // Where a file named after the temporary addon goes, e.g. main-<key>.<pid>.tmp.x86-64-v3.node
+  // becomes main-<key>.x86-64-v3.node.
+  const installedPath = (builtPath: string, builtPrefix: string, prefix: string) => {
+    const installed = prefix + builtPath.slice(builtPrefix.length)
+
+    fs.renameSync(builtPath, installed)
+
+    return installed
+  }
+  const installedVariants = variants.map((variant: { path: string }) => ({
+    ...variant,
+    path: installedPath(variant.path, tmpPath.replace(/\.node$/, ""), addonPath.replace(/\.node$/, "")),
+  }))
+  const installedConstants =
+    constants === null
+      ? null
+      : Object.fromEntries(
+          Object.entries(constants).map(([name, constant]: [string, any]) => [
+            name,
+            "asset" in constant ? { ...constant, asset: installedPath(constant.asset, tmpPath, addonPath) } : constant,
+          ]),
+        )
+
+  fs.renameSync(tmpPath, addonPath)
+
+  // The shared runtime gets built in a temporary directory. Modules built with the same config
+  // get the same runtime, so naming the copy after its contents lets them share it.
+  let installedRuntime = null
+
+  if (runtime !== null) {
+    const contents = fs.readFileSync(runtime)
+
+    installedRuntime = path.join(cacheDir, `runtime-${sha256(contents).slice(0, 16)}.node`)
+
+    if (!fs.existsSync(installedRuntime)) {
+      writeFileAtomically(installedRuntime, contents)
+    }
+  }
+
+  return addonShim(sourcePath, [{ path: addonPath, variants: installedVariants, runtime: installedRuntime }], entryPoints, installedConstants, "cjs")
+}
+
+const transformer = {
+  getCacheKey(sourceText: string, sourcePath: string, options: TransformOptions): string {
+    return cacheKey(sourcePath, options.transformerConfig)
+  },
+
+  process(sourceText: string, sourcePath: string, options: TransformOptions): { code: string } {
+    const key = cacheKey(sourcePath, options.transformerConfig)
+    const cacheDir = path.join(options.config.cacheDirectory, "roc-esbuild")
+    const addonPath = path.join(cacheDir, `${path.basename(sourcePath, ".roc")}-${key.slice(0, 16)}.node`)
+    const shimPath = `${addonPath}.js`
+
+    if (!fs.existsSync(shimPath)) {
+      const lockPath = path.join(cacheDir, `${sha256(path.dirname(sourcePath)).slice(0, 16)}.lock`)
+
+      fs.mkdirSync(cacheDir, { recursive: true })
+      acquireLock(lockPath)
+
+      try {
+        // Another worker may have built it while we were waiting for the lock.
+        if (!fs.existsSync(shimPath)) {
+          writeFileAtomically(shimPath, buildShim(sourcePath, addonPath, cacheDir, options.transformerConfig || {}))
+        }
+      } finally {
+        fs.unlinkSync(lockPath)
+      }
+    }
+
+    return {
+      code: fs.readFileSync(shimPath, "utf8"),
+    }
+  },
+}
+
+module.exports = transformer
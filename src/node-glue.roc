@@ -27,17 +27,582 @@ makeGlue = \typesByArch ->
             else
                 buf
 
-    Ok [
-        {
-            # TODO get the input filename and make the output .d.ts file be based on that
-            name: "main.roc.d.ts",
-            content: dtsFileContent,
-        },
-    ]
+    dtsFile = {
+        # TODO get the input filename and make the output .d.ts file be based on that
+        name: "main.roc.d.ts",
+        content: dtsFileContent,
+    }
+
+    # Like the .d.ts file, the C glue only depends on 64-bit assumptions, so
+    # one architecture's types will do for all of them: aarch64's, or
+    # x86_64's if there are no aarch64 ones.
+    isArch = \arch -> \types -> (Types.target types).architecture == arch
+    glueTypes =
+        when List.findFirst typesByArch (isArch Aarch64) is
+            Ok types -> Ok types
+            Err NotFound -> List.findFirst typesByArch (isArch X86x64)
+
+    when glueTypes is
+        Ok types ->
+            typedFiles <- Result.try (typedGlue types)
+
+            Ok (List.prepend typedFiles dtsFile)
+
+        Err NotFound -> Ok [dtsFile]
+
+# Platforms whose mainForHost is `List U8 -> List U8` take and return JSON,
+# which node-to-roc.c handles on its own. For any other platform, generate C
+# that converts each entry point's arguments from Node values into the Roc
+# types it takes (and its return value back), along with the TypeScript
+# declarations for calling it. A platform can't mix the two, since the typed
+# glue would pass the JSON entry points' bytes as Uint8Arrays instead.
+typedGlue : Types -> Result (List File) Str
+typedGlue = \types ->
+    entryPoints = Types.entryPoints types |> List.dropIf isStreamEntryPoint
+
+    jsonNames =
+        entryPoints
+        |> List.keepIf \T _ id -> isJsonEntryPoint types id
+        |> List.map \T name _ -> name
+
+    if List.len jsonNames == List.len entryPoints then
+        Ok []
+    else if List.len jsonNames > 0 then
+        Err (mixedEntryPointsMessage jsonNames)
+    else
+        empty = { c: "", dts: "", exports: "" }
+        glue <- Result.try (List.walk entryPoints (Ok empty) (addEntryPointGlue types))
+
+        records = List.walk entryPoints [] \state, T _ id -> addRecords types state id
+        recordsC = List.walkWithIndex records "" \state, record, index -> Str.concat state (generateRecord record index)
+
+        needs128Bit = List.any entryPoints \T _ id -> uses128Bit types id
+        int128Check = if needs128Bit then cInt128Check else ""
+
+        c =
+            cGlueHeader
+            |> Str.concat int128Check
+            |> Str.concat recordsC
+            |> Str.concat glue.c
+            |> Str.concat (generateInit records glue.exports)
+
+        Ok [
+            { name: "node-glue.c", content: c },
+            { name: "node-glue.d.ts", content: glue.dts },
+            { name: "node-glue.json", content: entryPointsJson types entryPoints },
+        ]
+
+# What the plugin needs to know about the entry points: the name each one is
+# exported as, and whether it's a constant rather than a function.
+entryPointsJson : Types, List [T Str TypeId] -> Str
+entryPointsJson = \types, entryPoints ->
+    entries =
+        entryPoints
+        |> List.map \T name id ->
+            jsName = jsNameFor name
+            constant =
+                when Types.shape types id is
+                    Function _ -> "false"
+                    _ -> "true"
+
+            "  { \"name\": \"\(jsName)\", \"constant\": \(constant) }"
+        |> Str.joinWith ",\n"
+
+    "{ \"entryPoints\": [\n\(entries)\n] }\n"
+
+generateInit : List Record, Str -> Str
+generateInit = \records, exports ->
+    if List.isEmpty records then
+        """
+
+        static napi_value init(napi_env env, napi_value exports) {
+          if (init_addon(env, exports, NULL) == NULL\(exports)) {
+            return NULL;
+          }
+
+          return exports;
+        }
+
+        NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
+
+        """
+    else
+        functionCount = Num.toStr (2 * List.len records)
+        sources =
+            records
+            |> List.map recordFunctionSources
+            |> Str.joinWith ""
+        fieldNames =
+            records
+            |> List.map recordFunctionFieldNames
+            |> Str.joinWith ""
+
+        """
+
+        static const char *const record_functions[] = {
+        \(sources)};
+
+        static const char *const record_field_names[] = {
+        \(fieldNames)};
+
+        static napi_value init(napi_env env, napi_value exports) {
+          napi_ref functions;
+
+          if (init_addon(env, exports, NULL) == NULL ||
+              create_record_functions(env, record_functions, record_field_names, \(functionCount), &functions) != napi_ok\(exports)) {
+            return NULL;
+          }
+
+          return exports;
+        }
+
+        NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
+
+        """
+
+addEntryPointGlue : Types -> (Result { c : Str, dts : Str, exports : Str } Str, [T Str TypeId] -> Result { c : Str, dts : Str, exports : Str } Str)
+addEntryPointGlue = \types -> \result, T name id ->
+    soFar <- Result.try result
+    entryPoint <- Result.try (entryPointGlue types name id)
+
+    Ok {
+        c: Str.concat soFar.c entryPoint.c,
+        dts: Str.concat soFar.dts entryPoint.dts,
+        exports: Str.concat soFar.exports entryPoint.export,
+    }
+
+cGlueHeader : Str
+cGlueHeader =
+    """
+    // This file was generated by roc-esbuild's node-glue.roc, based on the
+    // types of the platform's entry points. It gets regenerated on every build.
+    #include "node-to-roc.h"
+
+    """
+
+# The C glue is the same for every target, but I128, U128, and Dec values
+# are passed as __int128, which C compilers for 32-bit targets (such as
+# linux-x32 and wasm32) don't have. Building for one of those fails with this
+# rather than with errors about the missing type.
+cInt128Check : Str
+cInt128Check =
+    """
+    #ifndef __SIZEOF_INT128__
+    #error "roc-esbuild can't pass I128, U128, or Dec values between Node and Roc on this target, because its C compiler has no 128-bit integer type"
+    #endif
+
+    """
+
+# Whether passing a value of this type (or calling this entry point) needs
+# C's __int128, including for fields of records.
+uses128Bit : Types, TypeId -> Bool
+uses128Bit = \types, id ->
+    when Types.shape types id is
+        Num I128 | Num U128 | Num Dec -> Bool.true
+        Function rocFn ->
+            rocFn.args
+            |> List.append rocFn.ret
+            |> List.any \argId -> uses128Bit types argId
+
+        Struct { fields } ->
+            when fields is
+                HasNoClosure list -> List.any list \field -> uses128Bit types field.id
+                HasClosure _ -> Bool.false
+
+        _ -> Bool.false
+
+# A JSON platform can also provide initForHost, stepForHost, and doneForHost
+# for streamRoc, which node-to-roc.c calls on its own. Their state is a Box,
+# which only Roc looks inside, so there's no glue to generate for them.
+isStreamEntryPoint : [T Str TypeId] -> Bool
+isStreamEntryPoint = \T name _ ->
+    List.contains ["initForHost", "stepForHost", "doneForHost"] name
+
+isJsonEntryPoint : Types, TypeId -> Bool
+isJsonEntryPoint = \types, id ->
+    when Types.shape types id is
+        Function rocFn ->
+            List.len rocFn.args == 1 && List.all rocFn.args (\arg -> isBytes types arg) && (isBytes types rocFn.ret || isBytesEffect types rocFn.ret)
+
+        _ -> Bool.false
+
+# An Effect (List U8), which node-to-roc.c runs so that Roc can call host
+# functions. To the host, an Effect is a closure that returns its value.
+isBytesEffect : Types, TypeId -> Bool
+isBytesEffect = \types, id ->
+    when Types.shape types id is
+        Function rocFn -> isBytes types rocFn.ret
+        _ -> Bool.false
+
+isBytes : Types, TypeId -> Bool
+isBytes = \types, id ->
+    when Types.shape types id is
+        RocList elemId ->
+            when Types.shape types elemId is
+                Num U8 -> Bool.true
+                _ -> Bool.false
+
+        _ -> Bool.false
+
+# How the generated C holds a value of some Roc type, and the node-to-roc.c
+# functions that convert it (node_into_roc_<conversion> and
+# roc_<conversion>_into_node).
+# Record conversions also take the addon's record functions (see generateRecord).
+CType : { cType : Str, conversion : Str, tsType : Str, byPointer : Bool, usesRecords : Bool }
+
+cTypeFor : Types, TypeId -> Result CType [Unsupported]
+cTypeFor = \types, id ->
+    scalar = \cType, conversion, tsType -> Ok { cType, conversion, tsType, byPointer: Bool.false, usesRecords: Bool.false }
+
+    when Types.shape types id is
+        Bool -> scalar "bool" "bool" "boolean"
+        Num I8 -> scalar "int8_t" "i8" "number"
+        Num U8 -> scalar "uint8_t" "u8" "number"
+        Num I16 -> scalar "int16_t" "i16" "number"
+        Num U16 -> scalar "uint16_t" "u16" "number"
+        Num I32 -> scalar "int32_t" "i32" "number"
+        Num U32 -> scalar "uint32_t" "u32" "number"
+        # These don't all fit in a JavaScript number, so they're bigints.
+        Num I64 -> scalar "int64_t" "i64" "bigint"
+        Num U64 -> scalar "uint64_t" "u64" "bigint"
+        Num I128 -> scalar "__int128" "i128" "bigint"
+        Num U128 -> scalar "unsigned __int128" "u128" "bigint"
+        # A Dec is an I128 that counts in units of 10^-18.
+        Num Dec -> scalar "__int128" "dec" "bigint"
+        Num F32 -> scalar "float" "f32" "number"
+        Num F64 -> scalar "double" "f64" "number"
+        # Lists and strings get passed to Roc by pointer.
+        RocStr -> Ok { cType: "struct RocStr", conversion: "str", tsType: "string", byPointer: Bool.true, usesRecords: Bool.false }
+        RocList _ ->
+            if isBytes types id then
+                Ok { cType: "struct RocBytes", conversion: "bytes", tsType: "Uint8Array", byPointer: Bool.true, usesRecords: Bool.false }
+            else
+                Err Unsupported
+
+        # Records become a C struct with the same fields, which also gets
+        # passed by pointer. Records that capture closures can't be.
+        Struct { name, fields } ->
+            when fields is
+                HasNoClosure list ->
+                    recordFields <- Result.try (recordFieldCTypes types list)
+
+                    tsFields =
+                        recordFields
+                        |> List.map \field -> "\(field.name): \(field.cType.tsType)"
+                        |> Str.joinWith ", "
+
+                    Ok {
+                        cType: "struct roc_record_\(name)",
+                        conversion: "record_\(name)",
+                        tsType: "{ \(tsFields) }",
+                        byPointer: Bool.true,
+                        usesRecords: Bool.true,
+                    }
+
+                HasClosure _ -> Err Unsupported
+
+        Unit -> scalar "uint8_t" "unit" "undefined"
+        _ -> Err Unsupported
+
+RecordField : { name : Str, cType : CType }
+
+# Types lists a record's fields in the order Roc lays them out in memory, so
+# the C struct declares them in that order too.
+recordFieldCTypes : Types, List { name : Str, id : TypeId } -> Result (List RecordField) [Unsupported]
+recordFieldCTypes = \types, fields ->
+    List.walk fields (Ok []) \result, field ->
+        soFar <- Result.try result
+        cType <- Result.try (cTypeFor types field.id)
+
+        # Like a {} argument, a {} field has no JavaScript equivalent.
+        if cType.conversion == "unit" then
+            Err Unsupported
+        else
+            Ok (List.append soFar { name: field.name, cType })
+
+Record : { name : Str, fields : List RecordField }
+
+# The records an entry point's arguments and return value use, including
+# records nested in those. Each gets added once, after the records its
+# fields use, so that C sees every struct declared before it gets used.
+addRecords : Types, List Record, TypeId -> List Record
+addRecords = \types, records, id ->
+    when Types.shape types id is
+        Function rocFn ->
+            rocFn.args
+            |> List.append rocFn.ret
+            |> List.walk records \state, argId -> addRecords types state argId
+
+        Struct { name, fields } ->
+            when fields is
+                HasNoClosure list ->
+                    withFields = List.walk list records \state, field -> addRecords types state field.id
+                    alreadyAdded = List.any withFields \record -> record.name == name
+
+                    when recordFieldCTypes types list is
+                        Ok recordFields if !alreadyAdded -> List.append withFields { name, fields: recordFields }
+                        _ -> withFields
+
+                HasClosure _ -> records
+
+        _ -> records
+
+# Record number `index` gets converted by functions index * 2 (its reader)
+# and index * 2 + 1 (its maker) in the generated record_functions. Fields are
+# always read and made in the order the struct declares them. Roc field names
+# are valid JavaScript property names as-is.
+recordFunctionSources : Record -> Str
+recordFunctionSources = \record ->
+    reads =
+        record.fields
+        |> List.map \field -> "record.\(field.name)"
+        |> Str.joinWith ", "
+
+    params =
+        record.fields
+        |> List.mapWithIndex \_, index -> "v\(Num.toStr index)"
+        |> Str.joinWith ", "
+
+    props =
+        record.fields
+        |> List.mapWithIndex \field, index -> "\(field.name): v\(Num.toStr index)"
+        |> Str.joinWith ", "
+
+    "  \"(function (record) { return [\(reads)]; })\",\n  \"(function (\(params)) { return { \(props) }; })\",\n"
+
+# What create_record_functions falls back on when Node doesn't allow compiling
+# the record's functions: the field names for each of them, in the same order.
+recordFunctionFieldNames : Record -> Str
+recordFunctionFieldNames = \record ->
+    names =
+        record.fields
+        |> List.map .name
+        |> Str.joinWith " "
+
+    "  \"\(names)\",\n  \"\(names)\",\n"
+
+generateRecord : Record, Nat -> Str
+generateRecord = \record, index ->
+    name = record.name
+    reader = Num.toStr (2 * index)
+    maker = Num.toStr (2 * index + 1)
+    fieldCount = Num.toStr (List.len record.fields)
+
+    cFields =
+        List.walk record.fields "" \state, field ->
+            cType = field.cType.cType
+            fieldName = field.name
+
+            "\(state)  \(cType) f_\(fieldName);\n"
+
+    intoRoc =
+        List.walkWithIndex record.fields "" \state, field, fieldIndex ->
+            fieldIndexStr = Num.toStr fieldIndex
+            conversion = field.cType.conversion
+            functionsArg = if field.cType.usesRecords then "functions, " else ""
+            fieldName = field.name
+
+            "\(state)  if ((status = napi_get_element(env, fields, \(fieldIndexStr), &field)) != napi_ok ||\n      (status = node_into_roc_\(conversion)(env, \(functionsArg)field, index, &out->f_\(fieldName))) != napi_ok) {\n    return status;\n  }\n\n"
+
+    intoNode =
+        List.walk record.fields "" \state, field ->
+            conversion = field.cType.conversion
+            functionsArg = if field.cType.usesRecords then "functions, " else ""
+            fieldName = field.name
+
+            "\(state)    roc_\(conversion)_into_node(env, \(functionsArg)value.f_\(fieldName)),\n"
+
+    # A field that's missing from the object is `undefined`, which the field's
+    # conversion reports as an argument of the wrong type. A record might only
+    # ever be passed to Roc or only returned from it, so either conversion may
+    # go unused.
+    """
+
+    struct roc_record_\(name) {
+    \(cFields)};
+
+    __attribute__((unused))
+    static napi_status node_into_roc_record_\(name)(napi_env env, napi_value functions, napi_value value, size_t index, struct roc_record_\(name) *out) {
+      napi_value fields;
+      napi_value field;
+      napi_status status = read_record_fields(env, functions, \(reader), value, index, &fields);
+
+      if (status != napi_ok) {
+        return status;
+      }
+
+    \(intoRoc)  return napi_ok;
+    }
+
+    __attribute__((unused))
+    static napi_value roc_record_\(name)_into_node(napi_env env, napi_value functions, struct roc_record_\(name) value) {
+      napi_value fields[\(fieldCount)] = {
+    \(intoNode)  };
+
+      return make_record(env, functions, \(maker), \(fieldCount), fields);
+    }
+
+    """
+
+mixedEntryPointsMessage : List Str -> Str
+mixedEntryPointsMessage = \jsonNames ->
+    names = Str.joinWith jsonNames ", "
+
+    "roc-esbuild can't mix entry points that take and return JSON (\(names)) with ones that take and return other types, because they get called in different ways. Give them all types other than `List U8 -> List U8`, or make them all JSON."
+
+unsupportedMessage : Str, Str -> Str
+unsupportedMessage = \name, what ->
+    "roc-esbuild can't pass \(what) of \(name) between Node and Roc yet. It currently supports Bool, Str, List U8, numbers, and records of those."
+
+entryPointGlue : Types, Str, TypeId -> Result { c : Str, dts : Str, export : Str } Str
+entryPointGlue = \types, name, id ->
+    when Types.shape types id is
+        Function rocFn ->
+            args <- Result.try (List.walkWithIndex rocFn.args (Ok []) (addArgCType types name))
+            ret <- Result.try (cTypeFor types rocFn.ret |> Result.mapErr \Unsupported -> unsupportedMessage name "the return value")
+
+            Ok (generateEntryPoint name args ret)
+
+        # A constant (e.g. a lookup table), which Roc exposes as a function of
+        # no arguments. The plugin can evaluate these at build time; see
+        # `inlineConstants` in build-roc.ts.
+        _ ->
+            ret <- Result.try (cTypeFor types id |> Result.mapErr \Unsupported -> unsupportedMessage name "the value")
+
+            Ok (generateEntryPoint name [] ret)
+
+addArgCType : Types, Str -> (Result (List CType) Str, TypeId, Nat -> Result (List CType) Str)
+addArgCType = \types, name -> \result, argId, index ->
+    soFar <- Result.try result
+    indexStr = Num.toStr (index + 1)
+
+    when cTypeFor types argId is
+        # JavaScript has no equivalent of passing {}.
+        Ok cType if cType.conversion != "unit" -> Ok (List.append soFar cType)
+        _ -> Err (unsupportedMessage name "argument \(indexStr)")
+
+# mainForHost is what callRoc has always called.
+jsNameFor : Str -> Str
+jsNameFor = \name -> if name == "mainForHost" then "callRoc" else name
+
+generateEntryPoint : Str, List CType, CType -> { c : Str, dts : Str, export : Str }
+generateEntryPoint = \name, args, ret ->
+    jsName = jsNameFor name
+    argc = Num.toStr (List.len args)
+    retType = ret.cType
+    retConversion = ret.conversion
+    retTsType = ret.tsType
+    retFunctionsArg = if ret.usesRecords then "functions, " else ""
+
+    # Entry points that take or return records get the addon's record
+    # functions as their callback data.
+    usesRecords = ret.usesRecords || List.any args .usesRecords
+    cbData = if usesRecords then "&functions_ref" else "NULL"
+    functionsDecl = if usesRecords then "  void *functions_ref;\n  napi_value functions;\n" else ""
+    getFunctions = if usesRecords then "\n  if (napi_get_reference_value(env, (napi_ref)functions_ref, &functions) != napi_ok) {\n    return NULL;\n  }\n" else ""
+
+    params =
+        List.walkWithIndex args "\(retType) *ret" \state, arg, index ->
+            indexStr = Num.toStr index
+            cType = arg.cType
+            pointer = if arg.byPointer then "*" else ""
+
+            "\(state), \(cType) \(pointer)arg\(indexStr)"
+
+    fields =
+        List.walkWithIndex args "  \(retType) ret;\n" \state, arg, index ->
+            indexStr = Num.toStr index
+            cType = arg.cType
+
+            "\(state)  \(cType) arg\(indexStr);\n"
+
+    callArgs =
+        List.walkWithIndex args "&call->ret" \state, arg, index ->
+            indexStr = Num.toStr index
+            pointer = if arg.byPointer then "&" else ""
+
+            "\(state), \(pointer)call->arg\(indexStr)"
+
+    conversions =
+        List.mapWithIndex args \arg, index ->
+            indexStr = Num.toStr index
+            conversion = arg.conversion
+            functionsArg = if arg.usesRecords then "functions, " else ""
+
+            "node_into_roc_\(conversion)(env, \(functionsArg)argv[\(indexStr)], \(indexStr), &call.arg\(indexStr)) != napi_ok"
+        |> Str.joinWith " ||\n      "
+
+    # Constants have no arguments to convert.
+    convertArgs =
+        if List.isEmpty args then
+            ""
+        else
+            "\n  if (\(conversions)) {\n    roc_call_abort();\n\n    return NULL;\n  }\n"
+
+    tsArgs =
+        List.walkWithIndex args "" \state, arg, index ->
+            indexStr = Num.toStr index
+            tsType = arg.tsType
+
+            "\(state)arg\(indexStr): \(tsType), "
+
+    c =
+        """
+
+        extern void roc__\(name)_1_exposed_generic(\(params));
+
+        struct \(name)_call {
+        \(fields)};
+
+        static void call_\(name)(void *data) {
+          struct \(name)_call *call = (struct \(name)_call *)data;
+
+          roc__\(name)_1_exposed_generic(\(callArgs));
+        }
+
+        static napi_value node_\(name)(napi_env env, napi_callback_info info) {
+          // One more than the Roc function takes, for callRoc's options. If fewer
+          // are passed, napi_get_cb_info fills in the rest with `undefined`.
+          size_t argc = \(argc) + 1;
+          napi_value argv[\(argc) + 1];
+          struct \(name)_call call;
+        \(functionsDecl)
+          if (napi_get_cb_info(env, info, &argc, argv, NULL, \(cbData)) != napi_ok) {
+            return NULL;
+          }
+        \(getFunctions)
+          if (!roc_call_begin(env)) {
+            return NULL;
+          }
+        \(convertArgs)
+          if (!roc_call_run(env, argv[\(argc)], call_\(name), &call)) {
+            return NULL;
+          }
+
+          napi_value answer = roc_\(retConversion)_into_node(env, \(retFunctionsArg)call.ret);
+
+          roc_call_end();
+
+          return answer;
+        }
+
+        """
+
+    {
+        c,
+        dts: "export function \(jsName)(\(tsArgs)options?: CallRocOptions): \(retTsType)\n",
+        export:
+            if usesRecords then
+                " ||\n      export_function_with_data(env, exports, \"\(jsName)\", node_\(name), functions) != napi_ok"
+            else
+                " ||\n      export_function(env, exports, \"\(jsName)\", node_\(name)) != napi_ok",
+    }
 
 addEntryPoints : Str, Types -> Str
 addEntryPoints = \buf, types ->
-    List.walk (Types.entryPoints types) buf \state, T name id ->
+    Types.entryPoints types
+    |> List.dropIf isStreamEntryPoint
+    |> List.walk buf \state, T name id ->
         addEntryPoint state types name id
 
 addEntryPoint : Str, Types, Str, TypeId -> Str
@@ -95,8 +660,9 @@ typeName = \types, id ->
         Bool -> "boolean"
         RocStr -> "string"
         Num U8 | Num I8 | Num U16 | Num I16 | Num U32 | Num I32 | Num F32 | Num F64 -> "number"
-        Num U64 | Num I64 | Num U128 | Num I128 -> "BigInt"
-        Num Dec -> crash "TODO convert from Roc Dec to some JavaScript type (possibly a C wrapper around RocDec?)"
+        Num U64 | Num I64 | Num U128 | Num I128 -> "bigint"
+        # A Dec is passed as a bigint of its value times 10^18, so it stays exact.
+        Num Dec -> "bigint"
         # Arguably Unit should be `void` in some contexts (e.g. Promises and return types),
         # but then again, why would you ever have a Roc function that returns {}? Perhaps more
         # relevantly, a Roc function that accepts {} as its argument should accept 0 arguments in TS.
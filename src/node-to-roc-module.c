@@ -0,0 +1,60 @@
+// The per-module part of an addon for a platform whose mainForHost takes and
+// returns JSON. It only connects this module's Roc code to Node; allocation,
+// crash handling, and marshalling all live in node-to-roc.c.
+//
+// With the `sharedRuntime` option, this is built on its own and linked against
+// the shared runtime addon (node-to-roc.c built with ROC_ESBUILD_RUNTIME). That
+// way a process with many Roc modules loads one copy of all that, and installs
+// its signal handlers once. Otherwise, node-to-roc.c includes this file, so
+// the addon is a single translation unit.
+#include "node-to-roc.h"
+
+extern void roc__mainForHost_1_exposed_generic(struct RocBytes *ret,
+                                               struct RocBytes *arg);
+
+// These only exist if mainForHost returns an Effect.
+extern int64_t roc__mainForHost_1_exposed_size(void) __attribute__((weak));
+extern void roc__mainForHost_0_caller(const uint8_t *unit, void *closure,
+                                      struct RocBytes *ret)
+    __attribute__((weak));
+
+static const struct RocJsonEffect effect = {
+    .size = roc__mainForHost_1_exposed_size,
+    .caller = roc__mainForHost_0_caller,
+};
+
+// These only exist if the platform can be streamed to.
+extern void roc__initForHost_1_exposed_generic(void **ret,
+                                               struct RocBytes *arg)
+    __attribute__((weak));
+extern void roc__stepForHost_1_exposed_generic(void **ret, void *state,
+                                               struct RocBytes *chunk)
+    __attribute__((weak));
+extern void roc__doneForHost_1_exposed_generic(struct RocBytes *ret,
+                                               void *state)
+    __attribute__((weak));
+
+static const struct RocJsonStream stream = {
+    .init = roc__initForHost_1_exposed_generic,
+    .step = roc__stepForHost_1_exposed_generic,
+    .done = roc__doneForHost_1_exposed_generic,
+};
+
+// Receive a value from Node, pass it to Roc as JSON, and then convert Roc's
+// JSON answer back into a Node value.
+static napi_value call_roc(napi_env env, napi_callback_info info) {
+  return call_roc_json(env, info, roc__mainForHost_1_exposed_generic,
+                       roc__mainForHost_0_caller != NULL ? &effect : NULL);
+}
+
+static napi_value init(napi_env env, napi_value exports) {
+  if (init_addon(env, exports, call_roc) == NULL ||
+      (stream.init != NULL && stream.step != NULL && stream.done != NULL &&
+       export_json_stream(env, exports, &stream) != napi_ok)) {
+    return NULL;
+  }
+
+  return exports;
+}
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
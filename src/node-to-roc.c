@@ -1,3 +1,10 @@
+// glibc only declares mremap (for large allocations) and dladdr (for the heap
+// profiler) with _GNU_SOURCE.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <alloca.h>
 #include <errno.h>
 #include <setjmp.h>
 #include <signal.h>
@@ -6,8 +13,48 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <sys/mman.h>
+
+#ifdef __linux__
+#include <malloc.h>
+#include <sys/syscall.h>
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#endif
+
+// Build with -DROC_ATOMIC_REFCOUNT (the `atomicRefcount` plugin option) when
+// retained Roc values may be shared between threads. Refcounts then change
+// atomically, and the allocator's bookkeeping takes a lock, since the last
+// reference may be dropped (and the value freed) on any thread. Single-threaded
+// builds keep the plain read-modify-write fast path and no lock.
+#ifdef ROC_ATOMIC_REFCOUNT
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
+
+// Build with -DROC_HEAP_PROFILE (the `heapProfile` plugin option) to have
+// roc_alloc and roc_realloc record what Roc allocates; see "Heap profiling".
+#ifdef ROC_HEAP_PROFILE
+#include <dlfcn.h>
+#include <stdarg.h>
+#endif
+
+// Build with -DROC_TRACE_EVENTS=n (the `trace` plugin option) to record the
+// phases of each call into a ring buffer of n events; see "Tracing".
+#if defined(ROC_TRACE_EVENTS) && ROC_TRACE_EVENTS > 0
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
+
+// Build with -DROC_STACK_SIZE=n (the `stackSize` plugin option) to run Roc on
+// a thread of its own with an n-byte stack; see "Running Roc on its own thread".
+#if defined(ROC_STACK_SIZE) && ROC_STACK_SIZE > 0
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
 
 // If you get an error about node_api.h not being found, run this to find out
 // the include path to use:
@@ -16,6 +63,8 @@
 // 'node'))"
 #include <node_api.h>
 
+#include "node-to-roc.h"
+
 // This is not volatile because it's only ever set inside a signal handler,
 // which according to chatGPT is fine.
 //
@@ -25,601 +74,4081 @@
 // an array type, and you can't cast array types.)
 jmp_buf jump_on_crash;
 
+// Whether jump_on_crash points into a call that's running on this thread (see
+// roc_call_guarded). With the `stackSize` option, Roc runs on another thread
+// than the one calling it, and only that thread may jump there.
+_Thread_local bool jump_on_crash_set = false;
+
+// What made the most recent Roc call jump back to call_roc.
+enum RocCrashKind {
+  ROC_CRASH_PANIC,
+  ROC_CRASH_SIGNAL,
+  ROC_CRASH_OUT_OF_MEMORY,
+  ROC_CRASH_TIMEOUT,
+  // A host function that Roc called threw; the exception is still pending.
+  ROC_CRASH_HOST_EXCEPTION,
+};
+
 // These are all volatile because they're used in signal handlers but can be set
 // outside the signal handler.
+volatile enum RocCrashKind last_crash_kind;
 volatile int last_signal;
 volatile char *last_roc_crash_msg;
+volatile size_t last_failed_alloc_size;
 
 void signal_handler(int sig) {
+  // Only the thread running Roc may jump back into its call. A crash anywhere
+  // else (outside of any call, or in a host function on Node's thread while
+  // the Roc thread waits) isn't Roc's, so it gets the signal's default action,
+  // just as it would have without this handler. SA_NODEFER lets the re-raised
+  // signal through right away.
+  if (!jump_on_crash_set) {
+    signal(sig, SIG_DFL);
+    raise(sig);
+
+    return;
+  }
+
   // Store the signal we encountered, and jump back to the handler
+  last_crash_kind = ROC_CRASH_SIGNAL;
   last_signal = sig;
   last_roc_crash_msg = NULL;
 
   longjmp(jump_on_crash, 1);
 }
 
-void *roc_alloc(size_t size, unsigned int u32align) {
-  size_t align = (size_t)u32align;
+// Timeouts
 
-  // Note: aligned_alloc only accepts alignments that are
-  // at least sizeof(void*) and also a power of two,
-  // so make sure it satisfies both of those.
+// A call can have a wall-clock timeout, a CPU-time timeout, or both.
+struct RocTimeouts {
+  double wall_ms;
+  double cpu_ms;
+};
 
-  // aligned_alloc also requires that the given size is a multiple
-  // of the alignment, so round to the nearest multiple of align.
-  size = (size + align - 1) & ~(align - 1);
+// Whether the thread is currently running Roc's own code, as opposed to not
+// being in a call at all, or being in one of the host functions Roc calls
+// (roc_alloc etc.). Only in the first case is it safe to longjmp out of a
+// timer signal handler; jumping out of the middle of malloc (or V8) would
+// leave its locks held. Otherwise the handler sets timeout_pending, and the
+// host function jumps once it's done.
+volatile sig_atomic_t roc_code_running = 0;
+volatile sig_atomic_t timeout_pending = 0;
 
-  return aligned_alloc(align, size);
-}
+// Identifies the timers of the current call, so a signal from an earlier
+// call's timer that was still in flight when we disarmed it gets ignored.
+volatile sig_atomic_t timeout_generation = 0;
 
-void *roc_realloc(void *ptr, size_t new_size, size_t old_size,
-                  unsigned int alignment) {
-  return realloc(ptr, new_size);
-}
+// Which of the timeouts expired, for the error message.
+volatile sig_atomic_t timeout_was_cpu = 0;
 
-void roc_dealloc(void *ptr, unsigned int alignment) { free(ptr); }
+bool timeouts_armed = false;
 
-void *roc_memcpy(void *dest, const void *src, size_t n) {
-  return memcpy(dest, src, n);
+void jump_on_timeout() {
+  roc_code_running = 0;
+  timeout_pending = 0;
+  last_crash_kind = ROC_CRASH_TIMEOUT;
+  last_roc_crash_msg = NULL;
+
+  longjmp(jump_on_crash, 1);
 }
 
-void *roc_memset(void *str, int c, size_t n) { return memset(str, c, n); }
+#ifdef __linux__
+// A realtime signal, so we don't take over a signal (like SIGALRM) that
+// something else in the process might be using.
+#define ROC_TIMEOUT_SIGNAL (SIGRTMIN + 3)
+
+// Older glibc versions don't define this name for the field.
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+timer_t wall_timer;
+timer_t cpu_timer;
+bool wall_timer_armed = false;
+bool cpu_timer_armed = false;
+
+void timeout_signal_handler(int sig, siginfo_t *info, void *ucontext) {
+  if (info->si_value.sival_int / 2 != timeout_generation) {
+    // This is from a previous call's timer.
+    return;
+  }
 
-// Reference counting
+  timeout_was_cpu = info->si_value.sival_int % 2;
 
-// If the refcount is set to this, that means the allocation is
-// stored in readonly memory in the binary, and we must not
-// attempt to increment or decrement it; if we do, we'll segfault!
-const ssize_t REFCOUNT_READONLY = 0;
-const ssize_t REFCOUNT_ONE = (ssize_t)PTRDIFF_MIN;
-const size_t MASK = (size_t)PTRDIFF_MIN;
+  if (roc_code_running) {
+    jump_on_timeout();
+  } else {
+    timeout_pending = 1;
+  }
+}
 
-// Increment reference count, given a pointer to the first element in a
-// collection. We don't need to check for overflow because in order to overflow
-// a usize worth of refcounts, you'd need to somehow have more pointers in
-// memory than the OS's virtual address space can hold.
-void incref(uint8_t *bytes, uint32_t alignment) {
-  ssize_t *refcount_ptr = ((ssize_t *)bytes) - 1;
-  ssize_t refcount = *refcount_ptr;
+// Create a one-shot timer on the given clock that signals this thread (rather
+// than whichever thread the kernel picks for process-directed signals, which
+// could be one that isn't running Roc at all).
+bool arm_timer(clockid_t clock, double ms, int is_cpu, timer_t *timer) {
+  struct sigevent event;
+  memset(&event, 0, sizeof(event));
+  event.sigev_notify = SIGEV_THREAD_ID;
+  event.sigev_signo = ROC_TIMEOUT_SIGNAL;
+  event.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+  event.sigev_value.sival_int = timeout_generation * 2 + is_cpu;
+
+  if (timer_create(clock, &event, timer) != 0) {
+    return false;
+  }
 
-  if (refcount != REFCOUNT_READONLY) {
-    *refcount_ptr = refcount + 1;
+  struct itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  spec.it_value.tv_sec = (time_t)(ms / 1000);
+  spec.it_value.tv_nsec = (long)((ms - (double)spec.it_value.tv_sec * 1000) * 1e6);
+
+  // A zero it_value would disarm the timer instead.
+  if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+    spec.it_value.tv_nsec = 1;
   }
+
+  timer_settime(*timer, 0, &spec, NULL);
+
+  return true;
 }
 
-// Decrement reference count, given a pointer to the first byte of a
-// collection's elements. Then call roc_dealloc if nothing is referencing this
-// collection anymore.
-void decref_heap_bytes(uint8_t *bytes, uint32_t alignment) {
-  size_t extra_bytes = (sizeof(size_t) >= (size_t)alignment)
-                           ? sizeof(size_t)
-                           : (size_t)alignment;
-  ssize_t *refcount_ptr = ((ssize_t *)bytes) - 1;
-  ssize_t refcount = *refcount_ptr;
+void arm_timeouts(struct RocTimeouts timeouts) {
+  timeout_generation = (timeout_generation + 1) & 0xFFFFFF;
+  timeout_pending = 0;
 
-  if (refcount == REFCOUNT_ONE) {
-    void *original_allocation =
-        (void *)(refcount_ptr - (extra_bytes - sizeof(size_t)));
+  if (timeouts.wall_ms > 0) {
+    wall_timer_armed = arm_timer(CLOCK_MONOTONIC, timeouts.wall_ms, 0, &wall_timer);
+  }
 
-    roc_dealloc(original_allocation, alignment);
-  } else if (refcount != REFCOUNT_READONLY) {
-    *refcount_ptr = refcount - 1;
+  if (timeouts.cpu_ms > 0) {
+    cpu_timer_armed =
+        arm_timer(CLOCK_THREAD_CPUTIME_ID, timeouts.cpu_ms, 1, &cpu_timer);
   }
+
+  timeouts_armed = wall_timer_armed || cpu_timer_armed;
 }
 
-// RocBytes (List U8)
+void disarm_timeouts() {
+  if (wall_timer_armed) {
+    timer_delete(wall_timer);
+    wall_timer_armed = false;
+  }
 
-struct RocBytes {
-  uint8_t *bytes;
-  size_t len;
-  size_t capacity;
-};
+  if (cpu_timer_armed) {
+    timer_delete(cpu_timer);
+    cpu_timer_armed = false;
+  }
 
-struct RocBytes empty_rocbytes() {
-  struct RocBytes ret = {
-      .len = 0,
-      .bytes = NULL,
-      .capacity = 0,
-  };
+  timeouts_armed = false;
+  timeout_pending = 0;
+}
 
-  return ret;
+void install_timeout_signal_handler() {
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = timeout_signal_handler;
+  // See init() for why SA_NODEFER.
+  action.sa_flags = SA_SIGINFO | SA_NODEFER;
+
+  sigaction(ROC_TIMEOUT_SIGNAL, &action, NULL);
 }
 
-struct RocBytes init_roc_bytes(uint8_t *bytes, size_t len, size_t capacity) {
-  if (len == 0) {
-    return empty_rocbytes();
-  } else {
-    struct RocBytes ret;
-    size_t refcount_size = sizeof(size_t);
-    uint8_t *new_refcount =
-        (uint8_t *)roc_alloc(len + refcount_size, __alignof__(size_t));
+// The timer signal does the work, so there's nothing to check.
+void check_timeouts() {}
+#else
+// Without per-thread timers (e.g. on macOS), check the deadlines whenever Roc
+// calls back into the host instead. This can't interrupt a loop that never
+// allocates, but it's cheap, and it's only done while a timeout is armed.
+struct timespec wall_deadline;
+struct timespec cpu_deadline;
+bool wall_deadline_armed = false;
+bool cpu_deadline_armed = false;
 
-    if (new_refcount == NULL) {
-      // TODO handle this more gracefully!
-      fprintf(stderr, "roc_alloc failed during init_roc_bytes in nodeJS; aborting\n");
-      abort();
-    }
+struct timespec deadline_after(clockid_t clock, double ms) {
+  struct timespec deadline;
+  clock_gettime(clock, &deadline);
 
-    uint8_t *new_content = new_refcount + refcount_size;
+  long long nsec = (long long)deadline.tv_nsec + (long long)(ms * 1e6);
 
-    ((ssize_t *)new_refcount)[0] = REFCOUNT_ONE;
+  deadline.tv_sec += (time_t)(nsec / 1000000000LL);
+  deadline.tv_nsec = (long)(nsec % 1000000000LL);
 
-    memcpy(new_content, bytes, len);
+  return deadline;
+}
 
-    ret.bytes = new_content;
-    ret.len = len;
-    ret.capacity = capacity;
+bool deadline_passed(clockid_t clock, struct timespec deadline) {
+  struct timespec now;
+  clock_gettime(clock, &now);
 
-    return ret;
-  }
+  return now.tv_sec > deadline.tv_sec ||
+         (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec);
 }
 
-// RocStr
+void arm_timeouts(struct RocTimeouts timeouts) {
+  timeout_pending = 0;
+  wall_deadline_armed = timeouts.wall_ms > 0;
+  cpu_deadline_armed = timeouts.cpu_ms > 0;
 
-struct RocStr {
-  uint8_t *bytes;
-  size_t len;
-  size_t capacity;
-};
+  if (wall_deadline_armed) {
+    wall_deadline = deadline_after(CLOCK_MONOTONIC, timeouts.wall_ms);
+  }
 
-struct RocStr empty_roc_str() {
-  struct RocStr ret = {
-      .len = 0,
-      .bytes = NULL,
-      .capacity = MASK,
-  };
+  if (cpu_deadline_armed) {
+    cpu_deadline = deadline_after(CLOCK_THREAD_CPUTIME_ID, timeouts.cpu_ms);
+  }
 
-  return ret;
+  timeouts_armed = wall_deadline_armed || cpu_deadline_armed;
 }
 
-struct RocBytes empty_roc_bytes() {
-  struct RocBytes ret = {
-      .len = 0,
-      .bytes = NULL,
-      .capacity = MASK,
-  };
-
-  return ret;
+void disarm_timeouts() {
+  wall_deadline_armed = false;
+  cpu_deadline_armed = false;
+  timeouts_armed = false;
+  timeout_pending = 0;
 }
 
-// Record the small string's length in the last byte of the given stack
-// allocation
-void write_small_str_len(size_t len, struct RocStr *str) {
-  ((uint8_t *)str)[sizeof(struct RocStr) - 1] = (uint8_t)len | 0b10000000;
+void install_timeout_signal_handler() {}
+
+void check_timeouts() {
+  if (wall_deadline_armed && deadline_passed(CLOCK_MONOTONIC, wall_deadline)) {
+    timeout_was_cpu = 0;
+    timeout_pending = 1;
+  } else if (cpu_deadline_armed &&
+             deadline_passed(CLOCK_THREAD_CPUTIME_ID, cpu_deadline)) {
+    timeout_was_cpu = 1;
+    timeout_pending = 1;
+  }
 }
+#endif
 
-struct RocStr roc_str_init_small(uint8_t *bytes, size_t len) {
-  // Start out with zeroed memory, so that
-  // if we end up comparing two small RocStr values
-  // for equality, we won't risk memory garbage resulting
-  // in two equal strings appearing unequal.
-  struct RocStr ret = empty_roc_str();
+// Call these at the start and end of every host function that Roc calls and
+// that isn't safe to longjmp out of.
+sig_atomic_t enter_host() {
+  sig_atomic_t was_running = roc_code_running;
 
-  // Copy the bytes into the stack allocation
-  memcpy(&ret, bytes, len);
+  roc_code_running = 0;
 
-  write_small_str_len(len, &ret);
+  return was_running;
+}
 
-  return ret;
+void leave_host(sig_atomic_t was_running) {
+  if (was_running && timeouts_armed) {
+    check_timeouts();
+
+    if (timeout_pending) {
+      jump_on_timeout();
+    }
+  }
+
+  roc_code_running = was_running;
 }
 
-struct RocStr roc_str_init_large(uint8_t *bytes, size_t len, size_t capacity) {
-  // A large RocStr is the same as a List U8 (aka RocBytes) in memory.
-  struct RocBytes roc_bytes = init_roc_bytes(bytes, len, capacity);
+// Memory
+
+// The default per-call memory limit, in bytes. 0 means unlimited. This can be
+// set at build time with the `memoryLimit` plugin option, and changed at
+// runtime with `setMemoryLimit`.
+#ifndef ROC_MEMORY_LIMIT
+#define ROC_MEMORY_LIMIT 0
+#endif
+
+// Allocations of at least this many bytes get pages of their own straight from
+// mmap, rather than coming from the malloc heap, so that roc_dealloc returns
+// them to the OS right away. 0 means never. Set with the `mmapThreshold`
+// plugin option; the `hugePages` option (-DROC_HUGE_PAGES) additionally backs
+// them with transparent huge pages, where the OS supports those.
+#ifndef ROC_MMAP_THRESHOLD
+#define ROC_MMAP_THRESHOLD 0
+#endif
+
+#define HUGE_PAGE_SIZE ((size_t)2 * 1024 * 1024)
+
+// Every allocation made by roc_alloc has one of these immediately before the
+// pointer it returns. This lets us account for how many bytes the current call
+// has live, and release everything it allocated if it crashes, without needing
+// any help from Roc (roc_dealloc doesn't tell us the size it's freeing).
+struct RocAllocation {
+  struct RocAllocation *prev;
+  struct RocAllocation *next;
+  // What the underlying allocator returned; this is what we free.
+  void *base;
+  // The size Roc asked for.
+  size_t size;
+  // Which call_roc made this allocation.
+  size_t call_id;
+  // If `base` came from mmap, the length of the mapping; otherwise 0.
+  size_t mapped_size;
+#ifdef ROC_HEAP_PROFILE
+  // 1 + the index of this allocation's entry in heap_profile_sites, or 0 if it
+  // wasn't sampled.
+  size_t heap_profile_site;
+#endif
+};
 
-  struct RocStr ret = {
-      .len = roc_bytes.len,
-      .bytes = roc_bytes.bytes,
-      .capacity = roc_bytes.capacity,
-  };
+// Allocations made during the current call_roc, so we can release them all if
+// the call crashes. These are circular doubly-linked lists with a sentinel
+// node, so unlinking never needs to know which list an allocation is in.
+struct RocAllocation call_allocations = {.prev = &call_allocations,
+                                         .next = &call_allocations};
+
+// Allocations that outlived the call that made them.
+struct RocAllocation retained_allocations = {.prev = &retained_allocations,
+                                             .next = &retained_allocations};
+
+size_t memory_limit = ROC_MEMORY_LIMIT;
+size_t current_call_id = 0;
+size_t call_allocated_bytes = 0;
+bool in_roc_call = false;
+
+// Every allocation that hasn't been freed yet (whichever call made it), and
+// how many allocations there have been in total, for getAllocatorStats.
+size_t live_bytes = 0;
+size_t live_allocations = 0;
+uint64_t total_allocations = 0;
+
+// Guards the allocation lists and counts above (and the heap profile) when
+// another thread may roc_dealloc; see ROC_ATOMIC_REFCOUNT.
+#ifdef ROC_ATOMIC_REFCOUNT
+pthread_mutex_t allocations_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#define lock_allocations() pthread_mutex_lock(&allocations_mutex)
+#define unlock_allocations() pthread_mutex_unlock(&allocations_mutex)
+#else
+#define lock_allocations()
+#define unlock_allocations()
+#endif
+
+struct RocAllocation *allocation_header(void *ptr) {
+  return ((struct RocAllocation *)ptr) - 1;
+}
 
-  return ret;
+void link_allocation(struct RocAllocation *list,
+                     struct RocAllocation *allocation) {
+  allocation->prev = list;
+  allocation->next = list->next;
+  list->next->prev = allocation;
+  list->next = allocation;
 }
 
-bool is_small_str(struct RocStr str) { return ((ssize_t)str.capacity) < 0; }
+void unlink_allocation(struct RocAllocation *allocation) {
+  allocation->prev->next = allocation->next;
+  allocation->next->prev = allocation->prev;
+}
 
-// Determine the length of the string, taking into
-// account the small string optimization
-size_t roc_str_len(struct RocStr str) {
-  uint8_t *bytes = (uint8_t *)&str;
-  uint8_t last_byte = bytes[sizeof(str) - 1];
-  uint8_t last_byte_xored = last_byte ^ 0b10000000;
-  size_t small_len = (size_t)(last_byte_xored);
-  size_t big_len = str.len & PTRDIFF_MAX; // Account for seamless slices
+// While Roc is running, jump back to roc_call_guarded, after which
+// roc_call_run throws a RangeError. Otherwise there's nothing to jump back to,
+// so roc_alloc returns NULL and its caller has to handle that. Within a call,
+// that means the code converting values into Roc on the calling thread: the
+// arguments, stream chunks, and host functions' answers (see host_call).
+// Those throw the same RangeError with throw_out_of_memory.
+void out_of_memory(size_t size) {
+  last_failed_alloc_size = size;
 
-  // Avoid branch misprediction costs by always
-  // determining both small_len and big_len,
-  // so this compiles to a cmov instruction.
-  if (is_small_str(str)) {
-    return small_len;
+  if (in_roc_call && jump_on_crash_set) {
+    last_crash_kind = ROC_CRASH_OUT_OF_MEMORY;
+    last_roc_crash_msg = NULL;
+
+    // Our caller (roc_alloc or roc_realloc) holds the lock, and won't get to
+    // release it.
+    unlock_allocations();
+
+    longjmp(jump_on_crash, 1);
+  }
+}
+
+// Returns whether allocating `size` more bytes in the current call would
+// exceed the memory limit.
+bool exceeds_memory_limit(size_t size) {
+  return in_roc_call && memory_limit != 0 &&
+         (size > memory_limit || call_allocated_bytes > memory_limit - size);
+}
+
+// Describe the allocation that last failed (or would have exceeded the memory
+// limit), with `in_use` bytes already allocated in the call, for a RangeError.
+void describe_out_of_memory(char *msg, size_t msg_size, size_t in_use,
+                            const char *doing) {
+  if (memory_limit == 0) {
+    snprintf(msg, msg_size,
+             "Roc ran out of memory trying to allocate %zu bytes (with %zu "
+             "bytes already in use) while %s",
+             (size_t)last_failed_alloc_size, in_use, doing);
   } else {
-    return big_len;
+    snprintf(msg, msg_size,
+             "Roc exceeded its memory limit of %zu bytes trying to allocate "
+             "%zu bytes (with %zu bytes already in use) while %s",
+             memory_limit, (size_t)last_failed_alloc_size, in_use, doing);
   }
 }
 
-size_t roc_str_len_small(struct RocStr str) {
-  uint8_t *bytes = (uint8_t *)&str;
-  uint8_t last_byte = bytes[sizeof(str) - 1];
-  uint8_t last_byte_xored = last_byte ^ 0b10000000;
+// Throw the RangeError for a roc_alloc that returned NULL while converting a
+// value into Roc. The caller still has to roc_call_abort.
+napi_status throw_out_of_memory(napi_env env) {
+  char msg[256];
 
-  return (size_t)(last_byte_xored);
+  describe_out_of_memory(msg, sizeof(msg), call_allocated_bytes,
+                         "passing a value to Roc");
+  napi_throw_range_error(env, NULL, msg);
+
+  return napi_pending_exception;
 }
 
-size_t roc_str_len_big(struct RocStr str) {
-  return str.len & PTRDIFF_MAX; // Account for seamless slices
+// How many bytes the allocator actually gave us at this address, which is
+// often more than we asked for. 0 where we can't ask.
+size_t usable_size(void *base) {
+#if defined(__linux__)
+  return malloc_usable_size(base);
+#elif defined(__APPLE__)
+  return malloc_size(base);
+#else
+  return 0;
+#endif
 }
 
-void decref_large_str(struct RocStr str) {
-  uint8_t *bytes;
+size_t page_size() {
+  static size_t cached = 0;
 
-  if ((ssize_t)str.len < 0) {
-    // This is a seamless slice, so the bytes are located in the capacity slot.
-    bytes = (uint8_t *)(str.capacity << 1);
-  } else {
-    bytes = str.bytes;
+  if (cached == 0) {
+    cached = (size_t)sysconf(_SC_PAGESIZE);
   }
 
-  decref_heap_bytes(bytes, __alignof__(uint8_t));
+  return cached;
 }
 
-void decref_roc_bytes(struct RocBytes arg) {
-  uint8_t *bytes;
+bool should_map(size_t size, size_t align) {
+#if ROC_MMAP_THRESHOLD > 0
+  return size >= ROC_MMAP_THRESHOLD && align <= page_size();
+#else
+  return false;
+#endif
+}
 
-  if ((ssize_t)arg.len < 0) {
-    // This is a seamless slice, so the bytes are located in the capacity slot.
-    bytes = (uint8_t *)(arg.capacity << 1);
-  } else {
-    bytes = arg.bytes;
-  }
+// How long a mapping needs to be to hold this many bytes.
+size_t mapping_size(size_t size) {
+#ifdef ROC_HUGE_PAGES
+  size_t granularity = HUGE_PAGE_SIZE;
+#else
+  size_t granularity = page_size();
+#endif
 
-  decref_heap_bytes(bytes, __alignof__(uint8_t));
+  return (size + granularity - 1) & ~(granularity - 1);
 }
 
-// Turn the given Node string into a RocStr and write it into the given RocStr
-// pointer.
-napi_status node_string_into_roc_str(napi_env env, napi_value node_string,
-                                     struct RocStr *roc_str) {
-  size_t len;
-  napi_status status;
-
-  // Passing NULL for a buffer (and size 0) will make it write the length of the
-  // string into `len`.
-  // https://nodejs.org/api/n-api.html#napi_get_value_string_utf8
-  status = napi_get_value_string_utf8(env, node_string, NULL, 0, &len);
+void advise_huge_pages(uint8_t *base, size_t length) {
+#if defined(ROC_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+  madvise(base, length, MADV_HUGEPAGE);
+#endif
+}
 
-  if (status != napi_ok) {
-    return status;
+// Map `length` (from mapping_size) bytes of fresh pages, or return NULL.
+uint8_t *map_pages(size_t length) {
+#ifdef ROC_HUGE_PAGES
+  // Huge pages can only back ranges that are aligned to the huge page size,
+  // so map an extra huge page's worth and trim off the unaligned ends.
+  size_t padded_length = length + HUGE_PAGE_SIZE;
+  uint8_t *mapping = (uint8_t *)mmap(NULL, padded_length,
+                                     PROT_READ | PROT_WRITE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (mapping == MAP_FAILED) {
+    return NULL;
   }
 
-  // Node's "write a string into this buffer" function always writes a null
-  // terminator, so capacity will need to be length + 1.
-  // https://nodejs.org/api/n-api.html#napi_get_value_string_utf8
-  size_t capacity = len + 1;
-
-  // Create a RocStr and write it into the out param
-  if (capacity < sizeof(struct RocStr)) {
-    // If it can fit in a small string, use the string itself as the buffer.
-    // First, zero out those bytes; small strings need to have zeroes for any
-    // bytes that are not part of the string, or else comparisons between small
-    // strings might fail.
-    *roc_str = empty_roc_str();
+  uint8_t *base = (uint8_t *)(((uintptr_t)mapping + HUGE_PAGE_SIZE - 1) &
+                              ~(HUGE_PAGE_SIZE - 1));
+  size_t head = base - mapping;
+  size_t tail = padded_length - head - length;
 
-    // This writes the actual number of bytes copied into len. Theoretically
-    // they should be the same, but it could be different if the buffer was
-    // somehow smaller. This way we guarantee that the RocStr does not present
-    // any memory garbage to the user.
-    status = napi_get_value_string_utf8(env, node_string, (char *)roc_str,
-                                        sizeof(struct RocStr), &len);
+  if (head != 0) {
+    munmap(mapping, head);
+  }
 
-    if (status != napi_ok) {
-      return status;
-    }
+  if (tail != 0) {
+    munmap(base + length, tail);
+  }
 
-    // We have to write the length into the buffer *after* Node copies its bytes
-    // in, because Node will have written a null terminator, which we may need
-    // to overwrite.
-    write_small_str_len(len, roc_str);
-  } else {
-    // capacity was too big for a small string, so make a heap allocation and
-    // write into that.
-    uint8_t *buf = (uint8_t *)roc_alloc(capacity, __alignof__(char));
+  advise_huge_pages(base, length);
 
-    // This writes the actual number of bytes copied into len. Theoretically
-    // they should be the same, but it could be different if the buffer was
-    // somehow smaller. This way we guarantee that the RocStr does not present
-    // any memory garbage to the user.
-    status = napi_get_value_string_utf8(env, node_string, (char *)buf, capacity,
-                                        &len);
+  return base;
+#else
+  void *base = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 
-    if (status != napi_ok) {
-      // Something went wrong, so free the bytes we just allocated before
-      // returning.
-      roc_dealloc((void *)buf, __alignof__(char *));
+  return base == MAP_FAILED ? NULL : (uint8_t *)base;
+#endif
+}
 
-      return status;
-    }
+// Resize a mapping from map_pages, moving it if need be. Returns NULL (leaving
+// the old mapping alone) on failure.
+uint8_t *remap_pages(uint8_t *base, size_t old_length, size_t new_length,
+                     size_t used_length) {
+#if defined(__linux__) && defined(ROC_HUGE_PAGES)
+  // Growing in place keeps the mapping's huge page alignment.
+  if (mremap(base, old_length, new_length, 0) != MAP_FAILED) {
+    advise_huge_pages(base, new_length);
 
-    *roc_str = roc_str_init_large(buf, len, capacity);
+    return base;
   }
 
-  return status;
-}
+  // Otherwise mremap would move the pages wherever it likes, which is usually
+  // not on a huge page boundary, so have map_pages find an aligned range and
+  // move them there instead. This still moves the pages themselves rather than
+  // copying their contents.
+  uint8_t *new_base = map_pages(new_length);
 
-// Turn the given Node string into a RocBytes and write it into the given
-// RocBytes pointer.
-napi_status node_string_into_roc_bytes(napi_env env, napi_value node_string,
-                                       struct RocBytes *roc_bytes) {
-  napi_status status;
-  size_t len;
+  if (new_base == NULL) {
+    return NULL;
+  }
 
-  // Passing NULL for a buffer (and size 0) will make it write the length of the
-  // string into `len`.
-  // https://nodejs.org/api/n-api.html#napi_get_value_string_utf8
-  status = napi_get_value_string_utf8(env, node_string, NULL, 0, &len);
+  if (mremap(base, old_length, new_length, MREMAP_MAYMOVE | MREMAP_FIXED,
+             new_base) == MAP_FAILED) {
+    munmap(new_base, new_length);
 
-  if (status != napi_ok) {
-    return status;
+    return NULL;
   }
 
-  // Node's "write a string into this buffer" function always writes a null
+  advise_huge_pages(new_base, new_length);
+
+  return new_base;
+#elif defined(__linux__)
+  // mremap moves the pages themselves rather than copying their contents.
+  void *new_base = mremap(base, old_length, new_length, MREMAP_MAYMOVE);
+
+  if (new_base == MAP_FAILED) {
+    return NULL;
+  }
+
+  return (uint8_t *)new_base;
+#else
+  uint8_t *new_base = map_pages(new_length);
+
+  if (new_base != NULL) {
+    memcpy(new_base, base, used_length);
+    munmap(base, old_length);
+  }
+
+  return new_base;
+#endif
+}
+
+void free_allocation(struct RocAllocation *allocation) {
+  if (allocation->mapped_size != 0) {
+    munmap(allocation->base, allocation->mapped_size);
+  } else {
+    free(allocation->base);
+  }
+}
+
+void *alloc_tracked(size_t size, unsigned int u32align) {
+  size_t align = (size_t)u32align;
+
+  // Note: aligned_alloc only accepts alignments that are
+  // at least sizeof(void*) and also a power of two,
+  // so make sure it satisfies both of those.
+  if (align < __alignof__(struct RocAllocation)) {
+    align = __alignof__(struct RocAllocation);
+  }
+
+  if (exceeds_memory_limit(size)) {
+    out_of_memory(size);
+
+    return NULL;
+  }
+
+  // Leave room for the header before the pointer we return, while keeping that
+  // pointer aligned.
+  size_t header_size =
+      (sizeof(struct RocAllocation) + align - 1) & ~(align - 1);
+
+  // aligned_alloc also requires that the given size is a multiple
+  // of the alignment, so round to the nearest multiple of align.
+  size_t total_size = (header_size + size + align - 1) & ~(align - 1);
+  size_t mapped_size = should_map(size, align) ? mapping_size(total_size) : 0;
+  uint8_t *base = mapped_size != 0 ? map_pages(mapped_size)
+                                   : (uint8_t *)aligned_alloc(align, total_size);
+
+  if (base == NULL) {
+    out_of_memory(size);
+
+    return NULL;
+  }
+
+  uint8_t *ptr = base + header_size;
+  struct RocAllocation *allocation = allocation_header(ptr);
+
+  allocation->base = base;
+  allocation->size = size;
+  allocation->call_id = current_call_id;
+  allocation->mapped_size = mapped_size;
+
+  live_bytes += size;
+  live_allocations++;
+  total_allocations++;
+
+  if (in_roc_call) {
+    call_allocated_bytes += size;
+    link_allocation(&call_allocations, allocation);
+  } else {
+    link_allocation(&retained_allocations, allocation);
+  }
+
+  return ptr;
+}
+
+void *realloc_tracked(void *ptr, size_t new_size, size_t old_size,
+                      unsigned int alignment) {
+  struct RocAllocation *allocation = allocation_header(ptr);
+  bool counts_toward_limit =
+      in_roc_call && allocation->call_id == current_call_id;
+
+  if (counts_toward_limit && new_size > allocation->size &&
+      exceeds_memory_limit(new_size - allocation->size)) {
+    out_of_memory(new_size);
+
+    return NULL;
+  }
+
+  // The neighbors in the list don't move, so remember them in order to point
+  // them at the header's new location afterwards.
+  struct RocAllocation *prev = allocation->prev;
+  struct RocAllocation *next = allocation->next;
+  uint8_t *base = (uint8_t *)allocation->base;
+  size_t header_size = (uint8_t *)ptr - base;
+  size_t old_allocation_size = allocation->size;
+  size_t align = (size_t)alignment;
+  size_t copy_size =
+      old_size < old_allocation_size ? old_size : old_allocation_size;
+  size_t mapped_size = allocation->mapped_size;
+  size_t new_mapped_size = 0;
+  uint8_t *new_base;
+
+  if (align < __alignof__(struct RocAllocation)) {
+    align = __alignof__(struct RocAllocation);
+  }
+
+  if (copy_size > new_size) {
+    copy_size = new_size;
+  }
+
+  if (mapped_size != 0) {
+    // Once a block has its own pages, it keeps them.
+    new_mapped_size = mapping_size(header_size + new_size);
+    new_base = new_mapped_size == mapped_size
+                   ? base
+                   : remap_pages(base, mapped_size, new_mapped_size,
+                                 header_size + copy_size);
+  } else if (should_map(new_size, align)) {
+    // A block that's grown past the threshold moves to its own pages, after
+    // which further growth can use remap_pages.
+    new_mapped_size = mapping_size(header_size + new_size);
+    new_base = map_pages(new_mapped_size);
+
+    if (new_base != NULL) {
+      memcpy(new_base + header_size - sizeof(struct RocAllocation), allocation,
+             sizeof(struct RocAllocation) + copy_size);
+      free(base);
+    }
+  } else if (header_size + new_size <= usable_size(base)) {
+    // The allocator's chunk already has room (List.append usually asks for a
+    // little more each time), so there's nothing to move.
+    new_base = base;
+  } else if (align <= __alignof__(max_align_t)) {
+    // realloc can grow the chunk in place, and for big chunks glibc uses
+    // mremap rather than copying.
+    new_base = (uint8_t *)realloc(base, header_size + new_size);
+  } else {
+    // realloc only guarantees malloc's own alignment, so over-aligned blocks
+    // have to move to a new aligned_alloc. Only the first old_size bytes are
+    // Roc's data, so that's all we need to copy.
+    size_t total_size = (header_size + new_size + align - 1) & ~(align - 1);
+
+    new_base = (uint8_t *)aligned_alloc(align, total_size);
+
+    if (new_base != NULL) {
+      memcpy(new_base + header_size - sizeof(struct RocAllocation),
+             allocation, sizeof(struct RocAllocation) + copy_size);
+      free(base);
+    }
+  }
+
+  if (new_base == NULL) {
+    // The original allocation (and its header) is untouched.
+    out_of_memory(new_size);
+
+    return NULL;
+  }
+
+  uint8_t *new_ptr = new_base + header_size;
+  struct RocAllocation *new_allocation = allocation_header(new_ptr);
+
+  new_allocation->base = new_base;
+  new_allocation->size = new_size;
+  new_allocation->mapped_size = new_mapped_size;
+  prev->next = new_allocation;
+  next->prev = new_allocation;
+
+  if (counts_toward_limit) {
+    call_allocated_bytes = call_allocated_bytes - old_allocation_size + new_size;
+  }
+
+  live_bytes = live_bytes - old_allocation_size + new_size;
+
+  return new_ptr;
+}
+
+void dealloc_tracked(void *ptr, unsigned int alignment) {
+  struct RocAllocation *allocation = allocation_header(ptr);
+
+  if (in_roc_call && allocation->call_id == current_call_id) {
+    call_allocated_bytes -= allocation->size;
+  }
+
+  live_bytes -= allocation->size;
+  live_allocations--;
+  unlink_allocation(allocation);
+  free_allocation(allocation);
+}
+
+// Heap profiling
+
+#ifdef ROC_HEAP_PROFILE
+// Record the native return address of roughly one allocation per this many
+// bytes allocated (so big allocations are more likely to be sampled), like
+// tcmalloc does. 0 means only record the size histogram.
+#ifndef ROC_HEAP_PROFILE_SAMPLE_BYTES
+#define ROC_HEAP_PROFILE_SAMPLE_BYTES 0
+#endif
+
+// Once this many distinct allocation sites have been seen, further ones get
+// lumped together under address 0.
+#define HEAP_PROFILE_MAX_SITES 4096
+
+// Size class i holds the allocations of [2^(i-1), 2^i) bytes (and class 0
+// holds the zero-byte ones).
+#define HEAP_PROFILE_SIZE_CLASSES (sizeof(size_t) * 8 + 1)
+
+struct HeapProfileCounts {
+  uint64_t allocations;
+  uint64_t allocated_bytes;
+  uint64_t live_allocations;
+  uint64_t live_bytes;
+};
+
+struct HeapProfileSite {
+  void *address;
+  struct HeapProfileCounts counts;
+};
+
+struct HeapProfileCounts heap_profile_sizes[HEAP_PROFILE_SIZE_CLASSES];
+struct HeapProfileSite heap_profile_sites[HEAP_PROFILE_MAX_SITES];
+size_t heap_profile_site_count = 0;
+int64_t heap_profile_bytes_until_sample = ROC_HEAP_PROFILE_SAMPLE_BYTES;
+
+size_t heap_profile_size_class(size_t size) {
+  return size == 0 ? 0 : sizeof(size_t) * 8 - __builtin_clzl(size);
+}
+
+void count_allocation(struct HeapProfileCounts *counts, size_t size) {
+  counts->allocations++;
+  counts->allocated_bytes += size;
+  counts->live_allocations++;
+  counts->live_bytes += size;
+}
+
+void count_deallocation(struct HeapProfileCounts *counts, size_t size) {
+  counts->live_allocations--;
+  counts->live_bytes -= size;
+}
+
+// Returns 1 + the index of the entry for this address, or 0 if this
+// allocation isn't being sampled.
+size_t heap_profile_sample(void *address, size_t size) {
+  if (ROC_HEAP_PROFILE_SAMPLE_BYTES == 0) {
+    return 0;
+  }
+
+  heap_profile_bytes_until_sample -= (int64_t)size;
+
+  if (heap_profile_bytes_until_sample > 0) {
+    return 0;
+  }
+
+  while (heap_profile_bytes_until_sample <= 0) {
+    heap_profile_bytes_until_sample += ROC_HEAP_PROFILE_SAMPLE_BYTES;
+  }
+
+  // There are few enough distinct call sites in practice that a linear search
+  // is fine here, and it only happens once per sample.
+  for (size_t index = 0; index < heap_profile_site_count; index++) {
+    if (heap_profile_sites[index].address == address) {
+      return index + 1;
+    }
+  }
+
+  if (heap_profile_site_count >= HEAP_PROFILE_MAX_SITES - 1) {
+    address = NULL;
+
+    for (size_t index = 0; index < heap_profile_site_count; index++) {
+      if (heap_profile_sites[index].address == NULL) {
+        return index + 1;
+      }
+    }
+  }
+
+  heap_profile_sites[heap_profile_site_count].address = address;
+
+  return ++heap_profile_site_count;
+}
+
+void heap_profile_alloc(void *ptr, void *return_address) {
+  struct RocAllocation *allocation = allocation_header(ptr);
+  size_t site = heap_profile_sample(return_address, allocation->size);
+
+  allocation->heap_profile_site = site;
+  count_allocation(
+      &heap_profile_sizes[heap_profile_size_class(allocation->size)],
+      allocation->size);
+
+  if (site != 0) {
+    count_allocation(&heap_profile_sites[site - 1].counts, allocation->size);
+  }
+}
+
+void heap_profile_free(struct RocAllocation *allocation) {
+  size_t site = allocation->heap_profile_site;
+
+  count_deallocation(
+      &heap_profile_sizes[heap_profile_size_class(allocation->size)],
+      allocation->size);
+
+  if (site != 0) {
+    count_deallocation(&heap_profile_sites[site - 1].counts, allocation->size);
+  }
+}
+#else
+#define heap_profile_alloc(ptr, return_address)
+#define heap_profile_free(allocation)
+#endif
+
+void *roc_alloc(size_t size, unsigned int alignment) {
+  sig_atomic_t was_running = enter_host();
+
+  lock_allocations();
+
+  void *ptr = alloc_tracked(size, alignment);
+
+  if (ptr != NULL) {
+    heap_profile_alloc(ptr, __builtin_return_address(0));
+  }
+
+  unlock_allocations();
+  leave_host(was_running);
+
+  return ptr;
+}
+
+void *roc_realloc(void *ptr, size_t new_size, size_t old_size,
+                  unsigned int alignment) {
+  sig_atomic_t was_running = enter_host();
+
+  lock_allocations();
+
+#ifdef ROC_HEAP_PROFILE
+  struct RocAllocation old_allocation = *allocation_header(ptr);
+#endif
+  void *new_ptr = realloc_tracked(ptr, new_size, old_size, alignment);
+
+#ifdef ROC_HEAP_PROFILE
+  // For the profile, a realloc is a free of the old allocation followed by an
+  // allocation of the new one.
+  if (new_ptr != NULL) {
+    heap_profile_free(&old_allocation);
+    heap_profile_alloc(new_ptr, __builtin_return_address(0));
+  }
+#endif
+
+  unlock_allocations();
+  leave_host(was_running);
+
+  return new_ptr;
+}
+
+void roc_dealloc(void *ptr, unsigned int alignment) {
+  sig_atomic_t was_running = enter_host();
+
+  lock_allocations();
+  heap_profile_free(allocation_header(ptr));
+  dealloc_tracked(ptr, alignment);
+  unlock_allocations();
+  leave_host(was_running);
+}
+
+// Start tracking the allocations of a new call_roc.
+void begin_call_allocations() {
+  lock_allocations();
+  current_call_id++;
+  call_allocated_bytes = 0;
+  in_roc_call = true;
+  unlock_allocations();
+}
+
+// The call finished normally, so whatever it allocated and didn't free is
+// still in use (e.g. it's referenced by a retained value).
+void retain_call_allocations() {
+  lock_allocations();
+
+  if (call_allocations.next != &call_allocations) {
+    // Splice the whole call list onto the front of the retained list.
+    struct RocAllocation *first = call_allocations.next;
+    struct RocAllocation *last = call_allocations.prev;
+
+    last->next = retained_allocations.next;
+    retained_allocations.next->prev = last;
+    retained_allocations.next = first;
+    first->prev = &retained_allocations;
+
+    call_allocations.next = &call_allocations;
+    call_allocations.prev = &call_allocations;
+  }
+
+  in_roc_call = false;
+  unlock_allocations();
+}
+
+// The call crashed, so nothing can be referencing what it allocated anymore.
+void release_call_allocations() {
+  lock_allocations();
+
+  struct RocAllocation *allocation = call_allocations.next;
+
+  while (allocation != &call_allocations) {
+    struct RocAllocation *next = allocation->next;
+
+    live_bytes -= allocation->size;
+    live_allocations--;
+    heap_profile_free(allocation);
+    free_allocation(allocation);
+
+    allocation = next;
+  }
+
+  call_allocations.next = &call_allocations;
+  call_allocations.prev = &call_allocations;
+  call_allocated_bytes = 0;
+  in_roc_call = false;
+  unlock_allocations();
+}
+
+void *roc_memcpy(void *dest, const void *src, size_t n) {
+  return memcpy(dest, src, n);
+}
+
+void *roc_memset(void *str, int c, size_t n) { return memset(str, c, n); }
+
+// Reference counting
+
+// If the refcount is set to this, that means the allocation is
+// stored in readonly memory in the binary, and we must not
+// attempt to increment or decrement it; if we do, we'll segfault!
+const ssize_t REFCOUNT_READONLY = 0;
+const ssize_t REFCOUNT_ONE = (ssize_t)PTRDIFF_MIN;
+const size_t MASK = (size_t)PTRDIFF_MIN;
+
+// Increment reference count, given a pointer to the first element in a
+// collection. We don't need to check for overflow because in order to overflow
+// a usize worth of refcounts, you'd need to somehow have more pointers in
+// memory than the OS's virtual address space can hold.
+void incref(uint8_t *bytes, uint32_t alignment) {
+  ssize_t *refcount_ptr = ((ssize_t *)bytes) - 1;
+
+#ifdef ROC_ATOMIC_REFCOUNT
+  _Atomic ssize_t *atomic_refcount_ptr = (_Atomic ssize_t *)refcount_ptr;
+
+  // A readonly refcount never changes, so it's safe to check it with a relaxed
+  // load before doing the (relaxed) increment. Nothing else needs to be ordered
+  // with an increment, because the caller already holds a reference.
+  if (atomic_load_explicit(atomic_refcount_ptr, memory_order_relaxed) !=
+      REFCOUNT_READONLY) {
+    atomic_fetch_add_explicit(atomic_refcount_ptr, 1, memory_order_relaxed);
+  }
+#else
+  ssize_t refcount = *refcount_ptr;
+
+  if (refcount != REFCOUNT_READONLY) {
+    *refcount_ptr = refcount + 1;
+  }
+#endif
+}
+
+// Decrement reference count, given a pointer to the first byte of a
+// collection's elements. Then call roc_dealloc if nothing is referencing this
+// collection anymore.
+void decref_heap_bytes(uint8_t *bytes, uint32_t alignment) {
+  size_t extra_bytes = (sizeof(size_t) >= (size_t)alignment)
+                           ? sizeof(size_t)
+                           : (size_t)alignment;
+  ssize_t *refcount_ptr = ((ssize_t *)bytes) - 1;
+
+#ifdef ROC_ATOMIC_REFCOUNT
+  _Atomic ssize_t *atomic_refcount_ptr = (_Atomic ssize_t *)refcount_ptr;
+
+  if (atomic_load_explicit(atomic_refcount_ptr, memory_order_relaxed) ==
+      REFCOUNT_READONLY) {
+    return;
+  }
+
+  // Release our writes to the other threads that still hold references, and
+  // have whichever thread drops the last reference acquire all of them before
+  // it frees the allocation. (This is the same pattern as std::shared_ptr.)
+  ssize_t refcount = atomic_fetch_sub_explicit(atomic_refcount_ptr, 1,
+                                               memory_order_release);
+
+  if (refcount == REFCOUNT_ONE) {
+    atomic_thread_fence(memory_order_acquire);
+
+    void *original_allocation =
+        (void *)(refcount_ptr - (extra_bytes - sizeof(size_t)));
+
+    roc_dealloc(original_allocation, alignment);
+  }
+#else
+  ssize_t refcount = *refcount_ptr;
+
+  if (refcount == REFCOUNT_ONE) {
+    void *original_allocation =
+        (void *)(refcount_ptr - (extra_bytes - sizeof(size_t)));
+
+    roc_dealloc(original_allocation, alignment);
+  } else if (refcount != REFCOUNT_READONLY) {
+    *refcount_ptr = refcount - 1;
+  }
+#endif
+}
+
+// RocBytes (List U8)
+
+struct RocBytes empty_rocbytes() {
+  struct RocBytes ret = {
+      .len = 0,
+      .bytes = NULL,
+      .capacity = 0,
+  };
+
+  return ret;
+}
+
+// Allocate the elements of a List U8 (or a large Str) with room for
+// `capacity` bytes, preceded by a refcount of one. Returns NULL if roc_alloc
+// does, which it only does outside a call; release it with
+// dealloc_roc_bytes.
+uint8_t *alloc_roc_bytes(size_t capacity) {
+  uint8_t *refcount =
+      (uint8_t *)roc_alloc(capacity + sizeof(size_t), __alignof__(size_t));
+
+  if (refcount == NULL) {
+    return NULL;
+  }
+
+  ((ssize_t *)refcount)[0] = REFCOUNT_ONE;
+
+  return refcount + sizeof(size_t);
+}
+
+void dealloc_roc_bytes(uint8_t *bytes) {
+  roc_dealloc(bytes - sizeof(size_t), __alignof__(size_t));
+}
+
+// Copy `len` bytes into a new List U8 with room for `capacity` bytes (or
+// `len`, if that's more), and write it into `out`. Returns false if roc_alloc
+// returned NULL, which it does when converting a value into Roc would exceed
+// the call's memory limit (or there's no memory left); see out_of_memory.
+bool init_roc_bytes(uint8_t *bytes, size_t len, size_t capacity,
+                    struct RocBytes *out) {
+  if (len == 0) {
+    *out = empty_rocbytes();
+
+    return true;
+  }
+
+  if (capacity < len) {
+    capacity = len;
+  }
+
+  uint8_t *new_content = alloc_roc_bytes(capacity);
+
+  if (new_content == NULL) {
+    return false;
+  }
+
+  memcpy(new_content, bytes, len);
+
+  out->bytes = new_content;
+  out->len = len;
+  out->capacity = capacity;
+
+  return true;
+}
+
+// RocStr
+
+struct RocStr empty_roc_str() {
+  struct RocStr ret = {
+      .len = 0,
+      .bytes = NULL,
+      .capacity = MASK,
+  };
+
+  return ret;
+}
+
+struct RocBytes empty_roc_bytes() {
+  struct RocBytes ret = {
+      .len = 0,
+      .bytes = NULL,
+      .capacity = MASK,
+  };
+
+  return ret;
+}
+
+// Record the small string's length in the last byte of the given stack
+// allocation
+void write_small_str_len(size_t len, struct RocStr *str) {
+  ((uint8_t *)str)[sizeof(struct RocStr) - 1] = (uint8_t)len | 0b10000000;
+}
+
+struct RocStr roc_str_init_small(uint8_t *bytes, size_t len) {
+  // Start out with zeroed memory, so that
+  // if we end up comparing two small RocStr values
+  // for equality, we won't risk memory garbage resulting
+  // in two equal strings appearing unequal.
+  struct RocStr ret = empty_roc_str();
+
+  // Copy the bytes into the stack allocation
+  memcpy(&ret, bytes, len);
+
+  write_small_str_len(len, &ret);
+
+  return ret;
+}
+
+// Returns false if the allocation failed, like init_roc_bytes.
+bool roc_str_init_large(uint8_t *bytes, size_t len, size_t capacity,
+                        struct RocStr *out) {
+  // A large RocStr is the same as a List U8 (aka RocBytes) in memory.
+  struct RocBytes roc_bytes;
+
+  if (!init_roc_bytes(bytes, len, capacity, &roc_bytes)) {
+    return false;
+  }
+
+  out->len = roc_bytes.len;
+  out->bytes = roc_bytes.bytes;
+  out->capacity = roc_bytes.capacity;
+
+  return true;
+}
+
+bool is_small_str(struct RocStr str) { return ((ssize_t)str.capacity) < 0; }
+
+// Determine the length of the string, taking into
+// account the small string optimization
+size_t roc_str_len(struct RocStr str) {
+  uint8_t *bytes = (uint8_t *)&str;
+  uint8_t last_byte = bytes[sizeof(str) - 1];
+  uint8_t last_byte_xored = last_byte ^ 0b10000000;
+  size_t small_len = (size_t)(last_byte_xored);
+  size_t big_len = str.len & PTRDIFF_MAX; // Account for seamless slices
+
+  // Avoid branch misprediction costs by always
+  // determining both small_len and big_len,
+  // so this compiles to a cmov instruction.
+  if (is_small_str(str)) {
+    return small_len;
+  } else {
+    return big_len;
+  }
+}
+
+size_t roc_str_len_small(struct RocStr str) {
+  uint8_t *bytes = (uint8_t *)&str;
+  uint8_t last_byte = bytes[sizeof(str) - 1];
+  uint8_t last_byte_xored = last_byte ^ 0b10000000;
+
+  return (size_t)(last_byte_xored);
+}
+
+size_t roc_str_len_big(struct RocStr str) {
+  return str.len & PTRDIFF_MAX; // Account for seamless slices
+}
+
+void decref_large_str(struct RocStr str) {
+  uint8_t *bytes;
+
+  if ((ssize_t)str.len < 0) {
+    // This is a seamless slice, so the bytes are located in the capacity slot.
+    bytes = (uint8_t *)(str.capacity << 1);
+  } else {
+    bytes = str.bytes;
+  }
+
+  if (bytes == NULL) {
+    return;
+  }
+
+  decref_heap_bytes(bytes, __alignof__(uint8_t));
+}
+
+void decref_roc_bytes(struct RocBytes arg) {
+  uint8_t *bytes;
+
+  if ((ssize_t)arg.len < 0) {
+    // This is a seamless slice, so the bytes are located in the capacity slot.
+    bytes = (uint8_t *)(arg.capacity << 1);
+  } else {
+    bytes = arg.bytes;
+  }
+
+  // An empty list has no heap allocation (and therefore no refcount) at all.
+  if (bytes == NULL) {
+    return;
+  }
+
+  decref_heap_bytes(bytes, __alignof__(uint8_t));
+}
+
+// Determine the length of the list, taking into account seamless slices.
+// (For a seamless slice, `bytes` already points to the first element of the
+// slice, so only the length needs adjusting.)
+size_t roc_bytes_len(struct RocBytes roc_bytes) {
+  return roc_bytes.len & PTRDIFF_MAX; // Account for seamless slices
+}
+
+// Turn the given Node string into a RocStr and write it into the given RocStr
+// pointer. Throws a RangeError if there isn't memory for it.
+napi_status node_string_into_roc_str(napi_env env, napi_value node_string,
+                                     struct RocStr *roc_str) {
+  size_t len;
+  napi_status status;
+
+  // Passing NULL for a buffer (and size 0) will make it write the length of the
+  // string into `len`.
+  // https://nodejs.org/api/n-api.html#napi_get_value_string_utf8
+  status = napi_get_value_string_utf8(env, node_string, NULL, 0, &len);
+
+  if (status != napi_ok) {
+    return status;
+  }
+
+  // Node's "write a string into this buffer" function always writes a null
+  // terminator, so capacity will need to be length + 1.
+  // https://nodejs.org/api/n-api.html#napi_get_value_string_utf8
+  size_t capacity = len + 1;
+
+  // Create a RocStr and write it into the out param
+  if (capacity < sizeof(struct RocStr)) {
+    // If it can fit in a small string, use the string itself as the buffer.
+    // First, zero out those bytes; small strings need to have zeroes for any
+    // bytes that are not part of the string, or else comparisons between small
+    // strings might fail.
+    *roc_str = empty_roc_str();
+
+    // This writes the actual number of bytes copied into len. Theoretically
+    // they should be the same, but it could be different if the buffer was
+    // somehow smaller. This way we guarantee that the RocStr does not present
+    // any memory garbage to the user.
+    status = napi_get_value_string_utf8(env, node_string, (char *)roc_str,
+                                        sizeof(struct RocStr), &len);
+
+    if (status != napi_ok) {
+      return status;
+    }
+
+    // We have to write the length into the buffer *after* Node copies its bytes
+    // in, because Node will have written a null terminator, which we may need
+    // to overwrite.
+    write_small_str_len(len, roc_str);
+  } else {
+    // capacity was too big for a small string, so allocate a large string's
+    // bytes and have Node write straight into them.
+    uint8_t *buf = alloc_roc_bytes(capacity);
+
+    if (buf == NULL) {
+      return throw_out_of_memory(env);
+    }
+
+    // This writes the actual number of bytes copied into len. Theoretically
+    // they should be the same, but it could be different if the buffer was
+    // somehow smaller. This way we guarantee that the RocStr does not present
+    // any memory garbage to the user.
+    status = napi_get_value_string_utf8(env, node_string, (char *)buf, capacity,
+                                        &len);
+
+    if (status != napi_ok) {
+      // Something went wrong, so free the bytes we just allocated before
+      // returning.
+      dealloc_roc_bytes(buf);
+
+      return status;
+    }
+
+    roc_str->bytes = buf;
+    roc_str->len = len;
+    roc_str->capacity = capacity;
+  }
+
+  return status;
+}
+
+// Turn the given Node string into a RocBytes and write it into the given
+// RocBytes pointer. Throws a RangeError if there isn't memory for it.
+napi_status node_string_into_roc_bytes(napi_env env, napi_value node_string,
+                                       struct RocBytes *roc_bytes) {
+  napi_status status;
+  size_t len;
+
+  // Passing NULL for a buffer (and size 0) will make it write the length of the
+  // string into `len`.
+  // https://nodejs.org/api/n-api.html#napi_get_value_string_utf8
+  status = napi_get_value_string_utf8(env, node_string, NULL, 0, &len);
+
+  if (status != napi_ok) {
+    return status;
+  }
+
+  // Node's "write a string into this buffer" function always writes a null
   // terminator, so capacity will need to be length + 1.
   // https://nodejs.org/api/n-api.html#napi_get_value_string_utf8
   size_t capacity = len + 1;
 
-  // Create a RocBytes and write it into the out param. Make sure we pass
-  // an align of a pointer, because roc_alloc calls aligned_alloc, which
-  // will not accept alignment values lower than the align of a pointer!
-  uint8_t *buf = (uint8_t *)roc_alloc(capacity, __alignof__(uint8_t*));
+  // An empty List U8 has no allocation.
+  if (len == 0) {
+    *roc_bytes = empty_rocbytes();
+
+    return napi_ok;
+  }
+
+  // Allocate the list's bytes and have Node write straight into them.
+  uint8_t *buf = alloc_roc_bytes(capacity);
+
+  if (buf == NULL) {
+    return throw_out_of_memory(env);
+  }
+
+  // This writes the actual number of bytes copied into len. Theoretically
+  // they should be the same, but it could be different if the buffer was
+  // somehow smaller. This way we guarantee that the RocBytes does not present
+  // any memory garbage to the user.
+  status =
+      napi_get_value_string_utf8(env, node_string, (char *)buf, capacity, &len);
+
+  if (status != napi_ok) {
+    // Something went wrong, so free the bytes we just allocated before
+    // returning.
+    dealloc_roc_bytes(buf);
+
+    return status;
+  }
+
+  roc_bytes->bytes = buf;
+  roc_bytes->len = len;
+  roc_bytes->capacity = capacity;
+
+  return status;
+}
+
+// Consume the given RocStr (decrement its refcount) after creating a Node
+// string from it.
+napi_value roc_str_into_node_string(napi_env env, struct RocStr roc_str) {
+  bool is_small = is_small_str(roc_str);
+  char *roc_str_contents;
+
+  if (is_small) {
+    // In a small string, the string itself contains its contents.
+    roc_str_contents = (char *)&roc_str;
+  } else {
+    // For a seamless slice, `bytes` points to the start of the slice (the
+    // original allocation is in the capacity slot), so this is correct either
+    // way; roc_str_len masks off the slice bit from the length.
+    roc_str_contents = (char *)roc_str.bytes;
+  }
+
+  napi_value answer;
+
+  if (napi_create_string_utf8(env, roc_str_contents, roc_str_len(roc_str),
+                              &answer) != napi_ok) {
+    answer = NULL;
+  }
+
+  // Decrement the RocStr because we consumed it.
+  if (!is_small) {
+    decref_large_str(roc_str);
+  }
+
+  return answer;
+}
+
+// Consume the given RocBytes (decrement its refcount) after creating a Node
+// string from it. (Assume we know these are UTF-8 bytes.)
+napi_value roc_bytes_into_node_string(napi_env env, struct RocBytes roc_bytes) {
+  napi_value answer;
+
+  if (napi_create_string_utf8(env, (char *)roc_bytes.bytes,
+                              roc_bytes_len(roc_bytes), &answer) != napi_ok) {
+    answer = NULL;
+  }
+
+  // Decrement the RocStr because we consumed it.
+  decref_roc_bytes(roc_bytes);
+
+  return answer;
+}
+
+// Create a Node string from the given RocStr.
+// Don't decrement the RocStr's refcount. (To decrement it, use
+// roc_str_into_node_string instead.)
+napi_value roc_str_as_node_string(napi_env env, struct RocStr roc_str) {
+  bool is_small = is_small_str(roc_str);
+  char *roc_str_contents;
+
+  if (is_small) {
+    // In a small string, the string itself contains its contents.
+    roc_str_contents = (char *)&roc_str;
+  } else {
+    roc_str_contents = (char *)roc_str.bytes;
+  }
+
+  napi_status status;
+  napi_value answer;
+
+  status = napi_create_string_utf8(env, roc_str_contents, roc_str_len(roc_str),
+                                   &answer);
+
+  if (status != napi_ok) {
+    return NULL;
+  }
+
+  // Do not decrement the RocStr's refcount because we did not consume it.
+
+  return answer;
+}
+
+// Create a Node string from the given RocBytes. (Assume we know these are
+// UTF-8 bytes.) Don't decrement the RocBytes's refcount. (To decrement it, use
+// roc_bytes_into_node_string instead.)
+napi_value roc_bytes_as_node_string(napi_env env, struct RocBytes roc_bytes) {
+  napi_value answer;
+
+  if (napi_create_string_utf8(env, (char *)roc_bytes.bytes,
+                              roc_bytes_len(roc_bytes), &answer) != napi_ok) {
+    return NULL;
+  }
+
+  return answer;
+}
+
+// Create a C string from the given RocStr. Don't reuse memory; do a fresh
+// malloc for it. Don't decrement the RocStr's refcount. (To decrement it, use
+// roc_str_into_c_string instead.)
+char *roc_str_into_c_string(struct RocStr roc_str) {
+  char *roc_str_contents;
+  size_t len;
+  bool is_small = is_small_str(roc_str);
+
+  if (is_small) {
+    // In a small string, the string itself contains its contents.
+    roc_str_contents = (char *)&roc_str;
+    len = roc_str_len_small(roc_str);
+  } else {
+    roc_str_contents = (char *)roc_str.bytes;
+    len = roc_str_len_big(roc_str);
+  }
+
+  char *buf = (char *)malloc(len + 1); // leave room for the \0 at the end
+
+  // Copy the bytes from the string into the buffer
+  memcpy(buf, roc_str_contents, len);
+
+  // Write the \0 at the end
+  buf[len] = '\0';
+
+  // Decrement the RocStr because we consumed it.
+  if (!is_small) {
+    decref_large_str(roc_str);
+  }
+
+  return buf;
+}
+
+void roc_panic(struct RocStr *roc_str) {
+  // We're about to malloc, so a timeout must not jump out of here.
+  roc_code_running = 0;
+  last_crash_kind = ROC_CRASH_PANIC;
+  last_signal = 0;
+  last_roc_crash_msg = roc_str_into_c_string(*roc_str);
+
+  longjmp(jump_on_crash, 1);
+}
+
+// Read a number property from a callRoc options object, treating `undefined`
+// as 0 (meaning "not set").
+napi_status get_timeout_option(napi_env env, napi_value options,
+                               const char *name, double *ms) {
+  napi_value value;
+  napi_valuetype type;
+  napi_status status = napi_get_named_property(env, options, name, &value);
+
+  if (status != napi_ok) {
+    return status;
+  }
+
+  status = napi_typeof(env, value, &type);
+
+  if (status != napi_ok) {
+    return status;
+  }
+
+  if (type == napi_undefined) {
+    *ms = 0;
+
+    return napi_ok;
+  }
+
+  status = napi_get_value_double(env, value, ms);
+
+  if (status == napi_ok && !(*ms >= 0)) {
+    return napi_invalid_arg;
+  }
+
+  return status;
+}
+
+// Read the { timeoutMs, cpuTimeoutMs } options object that can be passed to
+// callRoc after its argument. It's fine for it to be missing or undefined.
+napi_status get_timeouts(napi_env env, napi_value options,
+                         struct RocTimeouts *timeouts) {
+  napi_valuetype type;
+  napi_status status = napi_typeof(env, options, &type);
+
+  timeouts->wall_ms = 0;
+  timeouts->cpu_ms = 0;
+
+  if (status != napi_ok || type == napi_undefined) {
+    return status;
+  }
+
+  if (type != napi_object) {
+    return napi_object_expected;
+  }
+
+  status = get_timeout_option(env, options, "timeoutMs", &timeouts->wall_ms);
+
+  if (status != napi_ok) {
+    return status;
+  }
+
+  return get_timeout_option(env, options, "cpuTimeoutMs", &timeouts->cpu_ms);
+}
+
+// Typed values
+//
+// These convert between Node values and the Roc values that the C generated by
+// node-glue.roc passes to Roc directly, for platforms whose entry points take
+// and return Roc types rather than JSON. The node_into_roc_* functions throw a
+// TypeError naming the argument (`index` counts from 0) if the Node value has
+// the wrong type, and a RangeError if there isn't memory for its Roc copy; the
+// roc_*_into_node functions consume the Roc value.
+
+napi_status throw_argument_type_error(napi_env env, size_t index,
+                                      const char *expected) {
+  char msg[128];
+
+  snprintf(msg, sizeof(msg), "Roc expects argument %zu to be %s", index + 1,
+           expected);
+  napi_throw_type_error(env, NULL, msg);
+
+  return napi_pending_exception;
+}
+
+napi_status node_into_roc_str(napi_env env, napi_value value, size_t index,
+                              struct RocStr *out) {
+  napi_valuetype type;
+
+  if (napi_typeof(env, value, &type) != napi_ok || type != napi_string) {
+    return throw_argument_type_error(env, index, "a string");
+  }
+
+  return node_string_into_roc_str(env, value, out);
+}
+
+napi_status node_into_roc_bytes(napi_env env, napi_value value, size_t index,
+                                struct RocBytes *out) {
+  bool is_typedarray;
+  napi_typedarray_type type;
+  size_t len;
+  void *data;
+
+  // Buffers are Uint8Arrays too.
+  if (napi_is_typedarray(env, value, &is_typedarray) != napi_ok ||
+      !is_typedarray ||
+      napi_get_typedarray_info(env, value, &type, &len, &data, NULL, NULL) !=
+          napi_ok ||
+      (type != napi_uint8_array && type != napi_uint8_clamped_array)) {
+    return throw_argument_type_error(env, index, "a Uint8Array");
+  }
+
+  if (!init_roc_bytes((uint8_t *)data, len, len, out)) {
+    return throw_out_of_memory(env);
+  }
+
+  return napi_ok;
+}
+
+napi_status node_into_roc_bool(napi_env env, napi_value value, size_t index,
+                               bool *out) {
+  if (napi_get_value_bool(env, value, out) != napi_ok) {
+    return throw_argument_type_error(env, index, "a boolean");
+  }
+
+  return napi_ok;
+}
+
+napi_status node_into_roc_f64(napi_env env, napi_value value, size_t index,
+                              double *out) {
+  napi_valuetype type;
+
+  if (napi_typeof(env, value, &type) != napi_ok || type != napi_number ||
+      napi_get_value_double(env, value, out) != napi_ok) {
+    return throw_argument_type_error(env, index, "a number");
+  }
+
+  return napi_ok;
+}
+
+napi_status node_into_roc_f32(napi_env env, napi_value value, size_t index,
+                              float *out) {
+  double number;
+  napi_status status = node_into_roc_f64(env, value, index, &number);
+
+  *out = (float)number;
+
+  return status;
+}
+
+// Integers have to be whole numbers in the Roc type's range, rather than
+// silently wrapping or truncating.
+napi_status node_into_roc_integer(napi_env env, napi_value value, size_t index,
+                                  double min, double max, double *out) {
+  napi_status status = node_into_roc_f64(env, value, index, out);
+
+  if (status != napi_ok) {
+    return status;
+  }
+
+  if (!(*out >= min && *out <= max) || *out != (double)(int64_t)*out) {
+    char expected[64];
+
+    snprintf(expected, sizeof(expected), "an integer from %.0f to %.0f", min,
+             max);
+
+    return throw_argument_type_error(env, index, expected);
+  }
+
+  return napi_ok;
+}
+
+#define NODE_INTO_ROC_INTEGER(name, type, min, max)                            \
+  napi_status node_into_roc_##name(napi_env env, napi_value value,            \
+                                   size_t index, type *out) {                  \
+    double number;                                                             \
+    napi_status status =                                                       \
+        node_into_roc_integer(env, value, index, min, max, &number);           \
+                                                                               \
+    *out = (type)number;                                                       \
+                                                                               \
+    return status;                                                             \
+  }
+
+NODE_INTO_ROC_INTEGER(i8, int8_t, INT8_MIN, INT8_MAX)
+NODE_INTO_ROC_INTEGER(u8, uint8_t, 0, UINT8_MAX)
+NODE_INTO_ROC_INTEGER(i16, int16_t, INT16_MIN, INT16_MAX)
+NODE_INTO_ROC_INTEGER(u16, uint16_t, 0, UINT16_MAX)
+NODE_INTO_ROC_INTEGER(i32, int32_t, INT32_MIN, INT32_MAX)
+NODE_INTO_ROC_INTEGER(u32, uint32_t, 0, UINT32_MAX)
+
+// 64- and 128-bit integers (and Dec, which is an I128 counting in units of
+// 10^-18) are BigInts on the Node side, so they never lose precision.
+napi_status node_into_roc_i64(napi_env env, napi_value value, size_t index,
+                              int64_t *out) {
+  bool lossless;
+
+  if (napi_get_value_bigint_int64(env, value, out, &lossless) != napi_ok) {
+    return throw_argument_type_error(env, index, "a bigint");
+  }
+
+  if (!lossless) {
+    return throw_argument_type_error(env, index,
+                                     "a bigint that fits in a signed 64-bit "
+                                     "integer");
+  }
+
+  return napi_ok;
+}
+
+napi_status node_into_roc_u64(napi_env env, napi_value value, size_t index,
+                              uint64_t *out) {
+  bool lossless;
+
+  if (napi_get_value_bigint_uint64(env, value, out, &lossless) != napi_ok) {
+    return throw_argument_type_error(env, index, "a bigint");
+  }
+
+  if (!lossless) {
+    return throw_argument_type_error(env, index,
+                                     "a bigint that fits in an unsigned "
+                                     "64-bit integer");
+  }
+
+  return napi_ok;
+}
+
+#ifdef __SIZEOF_INT128__
+// Read a BigInt of up to 128 bits as its sign and magnitude.
+napi_status node_bigint_into_words(napi_env env, napi_value value,
+                                   size_t index, const char *expected,
+                                   int *sign_bit, unsigned __int128 *magnitude) {
+  uint64_t words[2] = {0, 0};
+  size_t word_count;
+
+  // Passing NULL for the words gets the number of words the BigInt needs.
+  if (napi_get_value_bigint_words(env, value, NULL, &word_count, NULL) !=
+      napi_ok) {
+    return throw_argument_type_error(env, index, "a bigint");
+  }
+
+  if (word_count > 2) {
+    return throw_argument_type_error(env, index, expected);
+  }
+
+  if (napi_get_value_bigint_words(env, value, sign_bit, &word_count, words) !=
+      napi_ok) {
+    return throw_argument_type_error(env, index, "a bigint");
+  }
+
+  *magnitude = ((unsigned __int128)words[1] << 64) | words[0];
+
+  return napi_ok;
+}
+
+napi_status node_into_roc_u128(napi_env env, napi_value value, size_t index,
+                               unsigned __int128 *out) {
+  const char *expected = "a bigint that fits in an unsigned 128-bit integer";
+  int sign_bit;
+  napi_status status =
+      node_bigint_into_words(env, value, index, expected, &sign_bit, out);
+
+  if (status != napi_ok) {
+    return status;
+  }
+
+  if (sign_bit != 0 && *out != 0) {
+    return throw_argument_type_error(env, index, expected);
+  }
+
+  return napi_ok;
+}
+
+napi_status node_into_roc_i128(napi_env env, napi_value value, size_t index,
+                               __int128 *out) {
+  const char *expected = "a bigint that fits in a signed 128-bit integer";
+  int sign_bit;
+  unsigned __int128 magnitude;
+  unsigned __int128 min_magnitude = (unsigned __int128)1 << 127;
+  napi_status status =
+      node_bigint_into_words(env, value, index, expected, &sign_bit, &magnitude);
+
+  if (status != napi_ok) {
+    return status;
+  }
+
+  if (sign_bit == 0 ? magnitude >= min_magnitude : magnitude > min_magnitude) {
+    return throw_argument_type_error(env, index, expected);
+  }
+
+  // Negating in unsigned arithmetic handles -2^127, whose magnitude doesn't fit
+  // in an __int128.
+  *out = (__int128)(sign_bit == 0 ? magnitude : -magnitude);
+
+  return napi_ok;
+}
+
+napi_status node_into_roc_dec(napi_env env, napi_value value, size_t index,
+                              __int128 *out) {
+  return node_into_roc_i128(env, value, index, out);
+}
+#endif
+
+napi_value roc_i64_into_node(napi_env env, int64_t value) {
+  napi_value answer;
+
+  return napi_create_bigint_int64(env, value, &answer) == napi_ok ? answer
+                                                                  : NULL;
+}
+
+napi_value roc_u64_into_node(napi_env env, uint64_t value) {
+  napi_value answer;
+
+  return napi_create_bigint_uint64(env, value, &answer) == napi_ok ? answer
+                                                                   : NULL;
+}
+
+#ifdef __SIZEOF_INT128__
+napi_value roc_bigint_words_into_node(napi_env env, int sign_bit,
+                                      unsigned __int128 magnitude) {
+  uint64_t words[2] = {(uint64_t)magnitude, (uint64_t)(magnitude >> 64)};
+  napi_value answer;
+
+  return napi_create_bigint_words(env, sign_bit, 2, words, &answer) == napi_ok
+             ? answer
+             : NULL;
+}
+
+napi_value roc_u128_into_node(napi_env env, unsigned __int128 value) {
+  return roc_bigint_words_into_node(env, 0, value);
+}
+
+napi_value roc_i128_into_node(napi_env env, __int128 value) {
+  unsigned __int128 magnitude = (unsigned __int128)value;
+
+  return roc_bigint_words_into_node(env, value < 0,
+                                    value < 0 ? -magnitude : magnitude);
+}
+
+napi_value roc_dec_into_node(napi_env env, __int128 value) {
+  return roc_i128_into_node(env, value);
+}
+#endif
+
+// Records
+//
+// The generated glue converts records with a pair of small JavaScript
+// functions per record type, compiled once when the addon loads: a reader,
+// which returns an array of the record's field values, and a maker, which
+// builds the record from its field values as an object literal. Reading or
+// setting each field through Node-API instead costs a property lookup (and a
+// hidden class transition, when setting) per field outside of V8's inline
+// caches, which made records of a dozen or so fields slower to pass than JSON.
+//
+// The functions live in an array (referenced by a napi_ref, which can only
+// point to objects), and get identified by their index in it.
+//
+// Compiling them needs eval, which Node doesn't allow when it's run with
+// --disallow-code-generation-from-strings. In that case each function's slot
+// holds an array of its record's field names instead, created once here, and
+// records get read and made with napi_get_property and napi_set_property.
+
+// An array of the space-separated names in `names`.
+static napi_status create_record_keys(napi_env env, const char *names,
+                                      napi_value *keys) {
+  napi_status status = napi_create_array(env, keys);
+  uint32_t index = 0;
+
+  while (status == napi_ok && *names != '\0') {
+    size_t length = strcspn(names, " ");
+    napi_value key;
+
+    status = napi_create_string_utf8(env, names, length, &key);
+
+    if (status == napi_ok) {
+      status = napi_set_element(env, *keys, index++, key);
+    }
+
+    names += length;
+    names += strspn(names, " ");
+  }
+
+  return status;
+}
+
+napi_status create_record_functions(napi_env env, const char *const *sources,
+                                    const char *const *field_names,
+                                    uint32_t count, napi_ref *out) {
+  napi_value functions;
+  napi_status status = napi_create_array_with_length(env, count, &functions);
+  bool can_compile = true;
+
+  for (uint32_t index = 0; status == napi_ok && index < count; index++) {
+    napi_value source;
+    napi_value function = NULL;
+
+    if (can_compile) {
+      status = napi_create_string_utf8(env, sources[index], NAPI_AUTO_LENGTH,
+                                       &source);
+
+      if (status == napi_ok) {
+        status = napi_run_script(env, source, &function);
+      }
+
+      // Code generation from strings is disallowed, which V8 reports by
+      // throwing an EvalError.
+      if (status == napi_pending_exception) {
+        napi_value exception;
+
+        status = napi_get_and_clear_last_exception(env, &exception);
+        can_compile = false;
+        function = NULL;
+      }
+    }
+
+    if (status == napi_ok && function == NULL) {
+      status = create_record_keys(env, field_names[index], &function);
+    }
+
+    if (status == napi_ok) {
+      status = napi_set_element(env, functions, index, function);
+    }
+  }
+
+  if (status != napi_ok) {
+    return status;
+  }
+
+  return napi_create_reference(env, functions, 1, out);
+}
+
+// The record function at `function_index`, or if it couldn't be compiled, its
+// record's field names (in which case `*is_function` is false).
+static napi_status get_record_function(napi_env env, napi_value functions,
+                                       uint32_t function_index,
+                                       napi_value *function,
+                                       bool *is_function) {
+  napi_valuetype type = napi_undefined;
+  napi_status status =
+      napi_get_element(env, functions, function_index, function);
+
+  if (status == napi_ok) {
+    status = napi_typeof(env, *function, &type);
+  }
+
+  *is_function = type == napi_function;
+
+  return status;
+}
+
+static napi_status call_record_function(napi_env env, napi_value function,
+                                        size_t argc, const napi_value *argv,
+                                        napi_value *result) {
+  napi_value undefined;
+  napi_status status = napi_get_undefined(env, &undefined);
+
+  if (status != napi_ok) {
+    return status;
+  }
+
+  return napi_call_function(env, undefined, function, argc, argv, result);
+}
+
+// Get an array of the record's field values (in the order of the struct's
+// fields) from the object passed as argument `index`.
+napi_status read_record_fields(napi_env env, napi_value functions,
+                               uint32_t reader, napi_value value, size_t index,
+                               napi_value *fields) {
+  napi_valuetype type;
+  napi_value function;
+  bool is_function;
+
+  if (napi_typeof(env, value, &type) != napi_ok || type != napi_object) {
+    return throw_argument_type_error(env, index, "an object");
+  }
+
+  napi_status status =
+      get_record_function(env, functions, reader, &function, &is_function);
+
+  if (status != napi_ok) {
+    return status;
+  }
+
+  if (is_function) {
+    return call_record_function(env, function, 1, &value, fields);
+  }
+
+  uint32_t count;
+
+  status = napi_get_array_length(env, function, &count);
+
+  if (status == napi_ok) {
+    status = napi_create_array_with_length(env, count, fields);
+  }
+
+  for (uint32_t field_index = 0; status == napi_ok && field_index < count;
+       field_index++) {
+    napi_value key;
+    napi_value field;
+
+    status = napi_get_element(env, function, field_index, &key);
+
+    if (status == napi_ok) {
+      status = napi_get_property(env, value, key, &field);
+    }
+
+    if (status == napi_ok) {
+      status = napi_set_element(env, *fields, field_index, field);
+    }
+  }
+
+  return status;
+}
+
+// Any of `fields` may be NULL if converting it failed, in which case this
+// returns NULL too.
+napi_value make_record(napi_env env, napi_value functions, uint32_t maker,
+                       size_t count, const napi_value *fields) {
+  napi_value record;
+
+  for (size_t index = 0; index < count; index++) {
+    if (fields[index] == NULL) {
+      return NULL;
+    }
+  }
+
+  napi_value function;
+  bool is_function;
+
+  if (get_record_function(env, functions, maker, &function, &is_function) !=
+      napi_ok) {
+    return NULL;
+  }
+
+  if (is_function) {
+    return call_record_function(env, function, count, fields, &record) ==
+                   napi_ok
+               ? record
+               : NULL;
+  }
+
+  if (napi_create_object(env, &record) != napi_ok) {
+    return NULL;
+  }
+
+  for (uint32_t index = 0; index < count; index++) {
+    napi_value key;
+
+    if (napi_get_element(env, function, index, &key) != napi_ok ||
+        napi_set_property(env, record, key, fields[index]) != napi_ok) {
+      return NULL;
+    }
+  }
+
+  return record;
+}
+
+napi_value roc_str_into_node(napi_env env, struct RocStr value) {
+  return roc_str_into_node_string(env, value);
+}
+
+napi_value roc_bytes_into_node(napi_env env, struct RocBytes value) {
+  napi_value answer;
+
+  if (napi_create_buffer_copy(env, roc_bytes_len(value), value.bytes, NULL,
+                              &answer) != napi_ok) {
+    answer = NULL;
+  }
+
+  decref_roc_bytes(value);
+
+  return answer;
+}
+
+napi_value roc_bool_into_node(napi_env env, bool value) {
+  napi_value answer;
+
+  return napi_get_boolean(env, value, &answer) == napi_ok ? answer : NULL;
+}
+
+napi_value roc_unit_into_node(napi_env env, uint8_t value) {
+  napi_value answer;
+
+  return napi_get_undefined(env, &answer) == napi_ok ? answer : NULL;
+}
+
+#define ROC_NUMBER_INTO_NODE(name, type)                                       \
+  napi_value roc_##name##_into_node(napi_env env, type value) {                \
+    napi_value answer;                                                         \
+                                                                               \
+    return napi_create_double(env, (double)value, &answer) == napi_ok          \
+               ? answer                                                        \
+               : NULL;                                                         \
+  }
+
+ROC_NUMBER_INTO_NODE(i8, int8_t)
+ROC_NUMBER_INTO_NODE(u8, uint8_t)
+ROC_NUMBER_INTO_NODE(i16, int16_t)
+ROC_NUMBER_INTO_NODE(u16, uint16_t)
+ROC_NUMBER_INTO_NODE(i32, int32_t)
+ROC_NUMBER_INTO_NODE(u32, uint32_t)
+ROC_NUMBER_INTO_NODE(f32, float)
+ROC_NUMBER_INTO_NODE(f64, double)
+
+// Tracing
+//
+// Built with the `trace` option, every call records when each of its phases
+// (e.g. JSON.stringify, copying the argument into Roc, Roc itself) started and
+// ended, into a fixed-size ring buffer that drainTraceEvents empties into
+// Chrome trace events. Their timestamps are on the clock that Node's own trace
+// events (and process.hrtime) use, so they line up with a trace from
+// `node --trace-events-enabled`, and with the build's trace file.
+
+// How many events the ring buffer holds (0 means don't trace at all). Once
+// it's full, each new event overwrites the oldest one.
+#ifndef ROC_TRACE_EVENTS
+#define ROC_TRACE_EVENTS 0
+#endif
+
+enum RocTracePhase {
+  ROC_TRACE_STRINGIFY,
+  ROC_TRACE_INTO_ROC,
+  ROC_TRACE_ROC,
+  ROC_TRACE_HOST_FUNCTION,
+  ROC_TRACE_OUT_OF_ROC,
+  ROC_TRACE_PARSE,
+  ROC_TRACE_MEMO_HIT,
+};
+
+#if ROC_TRACE_EVENTS > 0
+// The trace event names, by RocTracePhase.
+const char *const trace_phase_names[] = {
+    "JSON.stringify",  "argument into Roc", "Roc",      "host function",
+    "answer from Roc", "JSON.parse",        "memo hit",
+};
+
+// Each slot's `sequence` is one more than the ticket of the event in it, or 0
+// while a writer is filling it in, so a reader can tell whether what it read
+// is the event it wanted (rather than one half-overwritten by a newer one)
+// without any locking. The other fields are atomic only so that those racing
+// reads aren't undefined behavior; they're all relaxed.
+struct RocTraceEvent {
+  _Atomic uint64_t sequence;
+  _Atomic uint64_t start_ns;
+  _Atomic uint64_t end_ns;
+  _Atomic uint32_t thread_id;
+  _Atomic uint32_t phase;
+};
+
+struct RocTraceEvent trace_events[ROC_TRACE_EVENTS];
+
+// The next event's ticket, and the first ticket drainTraceEvents hasn't
+// returned yet. Ticket t goes in slot t % ROC_TRACE_EVENTS.
+_Atomic uint64_t trace_next_ticket = 0;
+_Atomic uint64_t trace_drained_ticket = 0;
+
+uint64_t trace_now() {
+  struct timespec now;
+
+  // libuv's hrtime (which Node's trace events use) is mach_absolute_time on
+  // macOS, which CLOCK_UPTIME_RAW reads, and CLOCK_MONOTONIC elsewhere.
+#ifdef __APPLE__
+  clock_gettime(CLOCK_UPTIME_RAW, &now);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &now);
+#endif
+
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+// The OS's id for the calling thread, which is what Node's trace events use
+// as their tid.
+uint32_t trace_thread_id() {
+  static _Thread_local uint32_t thread_id = 0;
+
+  if (thread_id == 0) {
+#if defined(__linux__)
+    thread_id = (uint32_t)syscall(SYS_gettid);
+#elif defined(__APPLE__)
+    uint64_t id;
+
+    pthread_threadid_np(NULL, &id);
+    thread_id = (uint32_t)id;
+#else
+    thread_id = 1;
+#endif
+  }
+
+  return thread_id;
+}
+
+// Record that `phase` ran from `start_ns` (a trace_now()) until now.
+void trace_event(enum RocTracePhase phase, uint64_t start_ns) {
+  uint64_t end_ns = trace_now();
+  uint64_t ticket = atomic_fetch_add_explicit(&trace_next_ticket, 1,
+                                              memory_order_relaxed);
+  struct RocTraceEvent *event = &trace_events[ticket % ROC_TRACE_EVENTS];
+
+  // Mark the slot as being written before writing any of it.
+  atomic_store_explicit(&event->sequence, 0, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  atomic_store_explicit(&event->start_ns, start_ns, memory_order_relaxed);
+  atomic_store_explicit(&event->end_ns, end_ns, memory_order_relaxed);
+  atomic_store_explicit(&event->thread_id, trace_thread_id(),
+                        memory_order_relaxed);
+  atomic_store_explicit(&event->phase, (uint32_t)phase, memory_order_relaxed);
+
+  atomic_store_explicit(&event->sequence, ticket + 1, memory_order_release);
+}
+
+// Set a Chrome trace event's property to a number.
+napi_status set_trace_number(napi_env env, napi_value event, const char *name,
+                             double number) {
+  napi_value value;
+  napi_status status = napi_create_double(env, number, &value);
+
+  return status == napi_ok
+             ? napi_set_named_property(env, event, name, value)
+             : status;
+}
+
+// Set a Chrome trace event's property to a string.
+napi_status set_trace_string(napi_env env, napi_value event, const char *name,
+                             const char *string) {
+  napi_value value;
+  napi_status status =
+      napi_create_string_utf8(env, string, NAPI_AUTO_LENGTH, &value);
+
+  return status == napi_ok
+             ? napi_set_named_property(env, event, name, value)
+             : status;
+}
+
+// { events, dropped }: the events recorded since the last drainTraceEvents,
+// oldest first, as Chrome trace events ("complete" ones, with their ts and dur
+// in microseconds), and how many events were overwritten before anything
+// drained them.
+napi_value drain_trace_events(napi_env env, napi_callback_info info) {
+  uint64_t end = atomic_load_explicit(&trace_next_ticket, memory_order_acquire);
+  uint64_t start =
+      atomic_load_explicit(&trace_drained_ticket, memory_order_relaxed);
+
+  // Claim [start, end), unless another thread drained past `start` first.
+  while (start < end &&
+         !atomic_compare_exchange_weak_explicit(&trace_drained_ticket, &start,
+                                                end, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+  }
+
+  if (start > end) {
+    start = end;
+  }
+
+  uint64_t dropped = 0;
+
+  if (end - start > ROC_TRACE_EVENTS) {
+    dropped = end - start - ROC_TRACE_EVENTS;
+    start = end - ROC_TRACE_EVENTS;
+  }
+
+  napi_value result;
+  napi_value events;
+  uint32_t count = 0;
+  double pid = (double)getpid();
+
+  if (napi_create_object(env, &result) != napi_ok ||
+      napi_create_array(env, &events) != napi_ok) {
+    return NULL;
+  }
+
+  for (uint64_t ticket = start; ticket < end; ticket++) {
+    struct RocTraceEvent *slot = &trace_events[ticket % ROC_TRACE_EVENTS];
+    uint64_t sequence =
+        atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    uint64_t start_ns =
+        atomic_load_explicit(&slot->start_ns, memory_order_relaxed);
+    uint64_t end_ns = atomic_load_explicit(&slot->end_ns, memory_order_relaxed);
+    uint32_t thread_id =
+        atomic_load_explicit(&slot->thread_id, memory_order_relaxed);
+    uint32_t phase = atomic_load_explicit(&slot->phase, memory_order_relaxed);
+
+    atomic_thread_fence(memory_order_acquire);
+
+    // The writer hasn't finished it yet, or a newer event has (or is) taking
+    // its place.
+    if (sequence != ticket + 1 ||
+        atomic_load_explicit(&slot->sequence, memory_order_relaxed) !=
+            sequence) {
+      dropped++;
+
+      continue;
+    }
+
+    napi_value event;
+
+    if (napi_create_object(env, &event) != napi_ok ||
+        set_trace_string(env, event, "name", trace_phase_names[phase]) !=
+            napi_ok ||
+        set_trace_string(env, event, "cat", "roc") != napi_ok ||
+        set_trace_string(env, event, "ph", "X") != napi_ok ||
+        set_trace_number(env, event, "ts", (double)start_ns / 1000) !=
+            napi_ok ||
+        set_trace_number(env, event, "dur",
+                         (double)(end_ns - start_ns) / 1000) != napi_ok ||
+        set_trace_number(env, event, "pid", pid) != napi_ok ||
+        set_trace_number(env, event, "tid", (double)thread_id) != napi_ok ||
+        napi_set_element(env, events, count++, event) != napi_ok) {
+      return NULL;
+    }
+  }
+
+  if (napi_set_named_property(env, result, "events", events) != napi_ok ||
+      set_trace_number(env, result, "dropped", (double)dropped) != napi_ok) {
+    return NULL;
+  }
+
+  return result;
+}
+#else
+uint64_t trace_now() { return 0; }
+
+void trace_event(enum RocTracePhase phase, uint64_t start_ns) {}
+
+napi_value drain_trace_events(napi_env env, napi_callback_info info) {
+  napi_throw_error(env, NULL,
+                   "This .roc file was built without the `trace` option, so "
+                   "it has no trace events");
+
+  return NULL;
+}
+#endif
+
+// Calling Roc
+
+// Whether a call is between roc_call_begin and its roc_call_end (or abort).
+// Calls can't nest, because there's only one jump_on_crash and one list of the
+// call's allocations, so a host function that Roc calls can't call Roc.
+bool roc_call_in_progress = false;
+
+// When the current phase of the call in progress started, for tracing.
+uint64_t call_phase_started = 0;
+
+// Start a call to Roc. Allocations made from here until roc_call_end count
+// toward this call's memory limit, and get released if it crashes.
+bool roc_call_begin(napi_env env) {
+  if (roc_call_in_progress) {
+    napi_throw_error(env, NULL,
+                     "Roc can't be called from a host function while Roc is "
+                     "already running");
+
+    return false;
+  }
+
+  roc_call_in_progress = true;
+  call_phase_started = trace_now();
+  begin_call_allocations();
+
+  return true;
+}
+
+// Give up on a call (e.g. because an argument couldn't be converted, or Roc
+// crashed), releasing everything allocated since roc_call_begin.
+void roc_call_abort() {
+  release_call_allocations();
+  roc_call_in_progress = false;
+}
+
+// Finish a call that succeeded. Whatever it allocated that's still live (e.g.
+// values Roc retained) outlives it.
+void roc_call_end() {
+  trace_event(ROC_TRACE_OUT_OF_ROC, call_phase_started);
+  retain_call_allocations();
+  roc_call_in_progress = false;
+}
+
+// Run `call(data)` with the given timeouts armed, on whichever thread Roc runs
+// on. Returns false if Roc crashed (or ran out of time or memory), in which
+// case last_crash_kind says how.
+bool roc_call_guarded(RocCall call, void *data, struct RocTimeouts timeouts) {
+  // Set the jump point so we can recover from a segfault.
+  if (setjmp(jump_on_crash) == 0) {
+    // This is *not* the result of a longjmp
+    jump_on_crash_set = true;
+
+    if (timeouts.wall_ms > 0 || timeouts.cpu_ms > 0) {
+      arm_timeouts(timeouts);
+    }
+
+    roc_code_running = 1;
+    call(data);
+    roc_code_running = 0;
+
+    if (timeouts_armed) {
+      disarm_timeouts();
+    }
+
+    jump_on_crash_set = false;
+
+    return true;
+  } else {
+    // This *is* the result of a longjmp.
+    roc_code_running = 0;
+
+    if (timeouts_armed) {
+      disarm_timeouts();
+    }
+
+    jump_on_crash_set = false;
+
+    return false;
+  }
+}
+
+// Running Roc on its own thread
+//
+// Roc recurses freely, and the stack of Node's main thread is only a few
+// megabytes, so deep recursion over a big input overflows it. With the
+// `stackSize` option, calls run on a thread with a stack that size instead,
+// while the calling thread waits. Host functions need N-API, so when Roc calls
+// one, the Roc thread hands it back to the calling thread to run.
+//
+// Handing over spins for a little while before going to sleep on a condition
+// variable, so that short calls don't pay for waking a thread up each way.
+
+#ifndef ROC_STACK_SIZE
+#define ROC_STACK_SIZE 0
+#endif
+
+#if ROC_STACK_SIZE > 0
+// How many times a waiting thread checks for its turn before going to sleep.
+#ifndef ROC_THREAD_SPINS
+#define ROC_THREAD_SPINS 2000
+#endif
+
+// With only one CPU, spinning just uses up the time the other thread needs to
+// finish, so this is 0 there; see start_roc_thread.
+int roc_thread_spins = 0;
+
+// The unmapped region below the Roc thread's stack, which turns an overflow
+// into SIGSEGV. Roc's stack frames can be big, so this is more than the usual
+// page, so that one frame can't step over it. It's only address space.
+#define ROC_STACK_GUARD_SIZE (1024 * 1024)
+
+// The stack signal_handler runs on in the Roc thread.
+#define ROC_ALT_STACK_SIZE (64 * 1024)
+
+enum RocThreadState {
+  ROC_THREAD_IDLE,
+  // The calling thread has handed over a call.
+  ROC_THREAD_CALL,
+  // Roc is waiting for the calling thread to run a host function.
+  ROC_THREAD_HOST_CALL,
+  ROC_THREAD_HOST_CALL_DONE,
+  ROC_THREAD_CALL_DONE,
+};
+
+struct RocThread {
+  atomic_int state;
+  pthread_mutex_t mutex;
+  pthread_cond_t changed;
+  bool started;
+
+  // The call being handed over, and whether it succeeded.
+  RocCall call;
+  void *data;
+  struct RocTimeouts timeouts;
+  bool succeeded;
+
+  // The host function call being handed back, and how it went.
+  struct RocStr *host_name;
+  struct RocBytes *host_arg;
+  struct RocBytes host_result;
+  bool host_succeeded;
+};
+
+struct RocThread roc_thread = {
+    .state = ROC_THREAD_IDLE,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .changed = PTHREAD_COND_INITIALIZER,
+};
+
+_Thread_local bool on_roc_thread = false;
+
+bool host_call(struct RocStr *name, struct RocBytes *arg,
+               struct RocBytes *result);
+
+void roc_thread_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ volatile("yield");
+#endif
+}
+
+void roc_thread_set_state(int state) {
+  // Store under the lock, so that a thread that's about to sleep on `changed`
+  // can't miss the broadcast.
+  pthread_mutex_lock(&roc_thread.mutex);
+  atomic_store_explicit(&roc_thread.state, state, memory_order_release);
+  pthread_cond_broadcast(&roc_thread.changed);
+  pthread_mutex_unlock(&roc_thread.mutex);
+}
+
+// Wait until the state is `a` or `b`, and return which it is.
+int roc_thread_wait(int a, int b) {
+  int state;
+
+  for (int spin = 0; spin < roc_thread_spins; spin++) {
+    state = atomic_load_explicit(&roc_thread.state, memory_order_acquire);
+
+    if (state == a || state == b) {
+      return state;
+    }
+
+    roc_thread_relax();
+  }
+
+  pthread_mutex_lock(&roc_thread.mutex);
+
+  for (;;) {
+    state = atomic_load_explicit(&roc_thread.state, memory_order_acquire);
+
+    if (state == a || state == b) {
+      break;
+    }
+
+    pthread_cond_wait(&roc_thread.changed, &roc_thread.mutex);
+  }
+
+  pthread_mutex_unlock(&roc_thread.mutex);
+
+  return state;
+}
+
+void *roc_thread_main(void *unused) {
+  stack_t alt_stack;
+
+  alt_stack.ss_sp = malloc(ROC_ALT_STACK_SIZE);
+  alt_stack.ss_size = ROC_ALT_STACK_SIZE;
+  alt_stack.ss_flags = 0;
+
+  if (alt_stack.ss_sp == NULL || sigaltstack(&alt_stack, NULL) != 0) {
+    fprintf(stderr,
+            "WARNING: roc-esbuild couldn't give the Roc thread an alternate "
+            "signal stack, so a stack overflow will crash the process.\n");
+  }
+
+  on_roc_thread = true;
+
+  for (;;) {
+    roc_thread_wait(ROC_THREAD_CALL, ROC_THREAD_CALL);
+
+    roc_thread.succeeded = roc_call_guarded(roc_thread.call, roc_thread.data,
+                                            roc_thread.timeouts);
+
+    roc_thread_set_state(ROC_THREAD_CALL_DONE);
+  }
+
+  return NULL;
+}
+
+bool start_roc_thread() {
+  pthread_attr_t attr;
+  pthread_t thread;
+  int err;
+
+  roc_thread_spins = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? ROC_THREAD_SPINS : 0;
+
+  if (pthread_attr_init(&attr) != 0) {
+    return false;
+  }
+
+  err = pthread_attr_setstacksize(&attr, (size_t)ROC_STACK_SIZE);
+
+  if (err == 0) {
+    err = pthread_attr_setguardsize(&attr, ROC_STACK_GUARD_SIZE);
+  }
+
+  if (err == 0) {
+    err = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  }
+
+  if (err == 0) {
+    err = pthread_create(&thread, &attr, roc_thread_main, NULL);
+  }
+
+  pthread_attr_destroy(&attr);
+
+  return err == 0;
+}
+
+// Run the call on the Roc thread (starting it, the first time), running the
+// host functions it hands back until it's done. If the thread can't be
+// started, run the call here after all.
+bool roc_thread_run(RocCall call, void *data, struct RocTimeouts timeouts) {
+  if (!roc_thread.started) {
+    if (!start_roc_thread()) {
+      fprintf(stderr,
+              "WARNING: roc-esbuild couldn't start a thread with a %lld-byte "
+              "stack to run Roc on, so Roc is running on the calling "
+              "thread.\n",
+              (long long)ROC_STACK_SIZE);
+
+      return roc_call_guarded(call, data, timeouts);
+    }
+
+    roc_thread.started = true;
+  }
+
+  roc_thread.call = call;
+  roc_thread.data = data;
+  roc_thread.timeouts = timeouts;
+  roc_thread_set_state(ROC_THREAD_CALL);
+
+  while (roc_thread_wait(ROC_THREAD_HOST_CALL, ROC_THREAD_CALL_DONE) ==
+         ROC_THREAD_HOST_CALL) {
+    roc_thread.host_succeeded = host_call(
+        roc_thread.host_name, roc_thread.host_arg, &roc_thread.host_result);
+
+    roc_thread_set_state(ROC_THREAD_HOST_CALL_DONE);
+  }
+
+  return roc_thread.succeeded;
+}
+
+// Called on the Roc thread: have the calling thread run a host function, and
+// wait for it to finish.
+bool roc_thread_host_call(struct RocStr *name, struct RocBytes *arg,
+                          struct RocBytes *result) {
+  roc_thread.host_name = name;
+  roc_thread.host_arg = arg;
+  roc_thread_set_state(ROC_THREAD_HOST_CALL);
+  roc_thread_wait(ROC_THREAD_HOST_CALL_DONE, ROC_THREAD_HOST_CALL_DONE);
+  *result = roc_thread.host_result;
+
+  return roc_thread.host_succeeded;
+}
+#endif
+
+// get_timeouts, throwing a TypeError if the options are invalid.
+bool read_timeouts(napi_env env, napi_value options,
+                   struct RocTimeouts *timeouts) {
+  if (get_timeouts(env, options, timeouts) != napi_ok) {
+    napi_throw_type_error(env, NULL,
+                          "callRoc expects its options to be an object whose "
+                          "timeoutMs and cpuTimeoutMs are non-negative numbers");
+
+    return false;
+  }
+
+  return true;
+}
+
+// Run `call(data)`, which calls into Roc, with the given callRoc options'
+// timeouts armed. If Roc crashes (or times out, or runs out of memory), this
+// releases everything the call allocated, throws a corresponding exception,
+// and returns false.
+bool roc_call_run(napi_env env, napi_value options, RocCall call, void *data) {
+  struct RocTimeouts timeouts;
+
+  if (!read_timeouts(env, options, &timeouts)) {
+    roc_call_abort();
+
+    return false;
+  }
+
+  // Everything since roc_call_begin was getting the arguments into Roc.
+  uint64_t roc_started = trace_now();
+
+  trace_event(ROC_TRACE_INTO_ROC, call_phase_started);
+
+#if ROC_STACK_SIZE > 0
+  bool succeeded = roc_thread_run(call, data, timeouts);
+#else
+  bool succeeded = roc_call_guarded(call, data, timeouts);
+#endif
+
+  trace_event(ROC_TRACE_ROC, roc_started);
+
+  if (succeeded) {
+    call_phase_started = trace_now();
+
+    return true;
+  } else {
+    // Roc crashed (or ran out of time or memory). Turn that into an exception.
+    if (last_crash_kind == ROC_CRASH_HOST_EXCEPTION) {
+      // Let callRoc throw what the host function threw.
+      roc_call_abort();
+
+      return false;
+    }
+
+    if (last_crash_kind == ROC_CRASH_TIMEOUT) {
+      roc_call_abort();
+
+      napi_throw_error(env, "ERR_ROC_TIMEOUT",
+                       timeout_was_cpu
+                           ? "Roc exceeded its CPU time limit (cpuTimeoutMs) "
+                             "while running `main` in a .roc file"
+                           : "Roc exceeded its time limit (timeoutMs) while "
+                             "running `main` in a .roc file");
+
+      return false;
+    }
+
+    if (last_crash_kind == ROC_CRASH_OUT_OF_MEMORY) {
+      // Free everything this call allocated, so that one oversized input
+      // doesn't leave the process short on memory for the next one.
+      size_t in_use = call_allocated_bytes;
+
+      roc_call_abort();
+
+      char msg[256];
+
+      describe_out_of_memory(msg, sizeof(msg), in_use,
+                             "running `main` in a .roc file");
+      napi_throw_range_error(env, NULL, msg);
+
+      return false;
+    }
+
+    // Nothing can be referencing what a crashed call allocated anymore, so
+    // free all of it. Otherwise every handled crash would leak.
+    roc_call_abort();
+
+    char *crash_msg = (char *)last_roc_crash_msg;
+    char *msg = crash_msg != NULL ? crash_msg : strsignal(last_signal);
+    char *suffix =
+        " while running `main` in a .roc file";
+    char *buf =
+        malloc(strlen(msg) + strlen(suffix) + 1); // +1 for the null terminator
+
+    strcpy(buf, msg);
+    strcat(buf, suffix);
+
+    napi_throw_error(env, NULL, buf);
+
+    free(buf);
+
+    // roc_panic malloc'd this in roc_str_into_c_string.
+    last_roc_crash_msg = NULL;
+    free(crash_msg);
+
+    return false;
+  }
+}
+
+
+// Host functions
+//
+// A platform whose mainForHost returns an Effect can declare the effect
+//
+//     hostCall : Str, List U8 -> Effect (List U8)
+//
+// for Roc to call JavaScript functions synchronously while it runs, e.g. to
+// look up just the data it needs, rather than having all of it serialized into
+// callRoc's argument up front. hostCall calls the function of that name in
+// callRoc's `hostFunctions` option, passing its argument and return value as
+// JSON (like callRoc's own). If it throws, the Roc call gets abandoned (like a
+// crash), and callRoc throws that exception.
+
+// The env and hostFunctions of the callRoc in progress, while Roc is running.
+napi_env host_env = NULL;
+napi_value host_functions = NULL;
+
+// Call JSON.stringify or JSON.parse. `value` may be NULL if converting it
+// from Roc failed, in which case this throws (if that didn't already).
+napi_status call_json(napi_env env, const char *method, napi_value value,
+                      napi_value *result) {
+  napi_value global;
+  napi_value json;
+  napi_value function;
+
+  if (value == NULL) {
+    bool is_exception_pending = false;
+
+    napi_is_exception_pending(env, &is_exception_pending);
+
+    if (!is_exception_pending) {
+      napi_throw_error(env, NULL,
+                       "Roc's answer couldn't be made into a Node string");
+    }
+
+    return napi_pending_exception;
+  }
+
+  napi_status status = napi_get_global(env, &global);
+
+  if (status == napi_ok) {
+    status = napi_get_named_property(env, global, "JSON", &json);
+  }
+
+  if (status == napi_ok) {
+    status = napi_get_named_property(env, json, method, &function);
+  }
+
+  if (status != napi_ok) {
+    return status;
+  }
+
+  return napi_call_function(env, json, function, 1, &value, result);
+}
+
+// Get callRoc's `hostFunctions` option, or NULL if it wasn't given.
+napi_status get_host_functions(napi_env env, napi_value options,
+                               napi_value *functions) {
+  napi_valuetype type;
+  napi_status status = napi_typeof(env, options, &type);
+
+  *functions = NULL;
+
+  // roc_call_run reports options that aren't an object.
+  if (status != napi_ok || type != napi_object) {
+    return status;
+  }
+
+  status = napi_get_named_property(env, options, "hostFunctions", functions);
+
+  if (status == napi_ok) {
+    status = napi_typeof(env, *functions, &type);
+  }
+
+  if (status != napi_ok || type == napi_undefined) {
+    *functions = NULL;
+
+    return status;
+  }
+
+  return type == napi_object ? napi_ok : napi_object_expected;
+}
+
+bool call_host_function(napi_env env, struct RocStr name, struct RocBytes arg,
+                        struct RocBytes *result) {
+  napi_value node_name = roc_str_as_node_string(env, name);
+  napi_value function;
+  napi_value node_arg;
+  napi_value undefined;
+  napi_value answer;
+  napi_value json;
+  napi_valuetype type;
+
+  if (host_functions == NULL || node_name == NULL ||
+      napi_get_property(env, host_functions, node_name, &function) != napi_ok ||
+      napi_typeof(env, function, &type) != napi_ok || type != napi_function) {
+    bool is_exception_pending = false;
+
+    napi_is_exception_pending(env, &is_exception_pending);
+
+    if (!is_exception_pending) {
+      char msg[256];
+      char *name_contents =
+          is_small_str(name) ? (char *)&name : (char *)name.bytes;
+
+      snprintf(msg, sizeof(msg),
+               "Roc called the host function \"%.*s\", which isn't one of the "
+               "functions in callRoc's hostFunctions option",
+               (int)roc_str_len(name), name_contents);
+      napi_throw_type_error(env, NULL, msg);
+    }
+
+    return false;
+  }
+
+  json = roc_bytes_as_node_string(env, arg);
+
+  if (json == NULL || call_json(env, "parse", json, &node_arg) != napi_ok ||
+      napi_get_undefined(env, &undefined) != napi_ok ||
+      napi_call_function(env, undefined, function, 1, &node_arg, &answer) !=
+          napi_ok ||
+      call_json(env, "stringify", answer, &json) != napi_ok ||
+      napi_typeof(env, json, &type) != napi_ok) {
+    return false;
+  }
+
+  // JSON.stringify returns undefined for undefined (e.g. when the function
+  // doesn't return anything), which isn't JSON; call that null instead.
+  if (type != napi_string &&
+      napi_create_string_utf8(env, "null", NAPI_AUTO_LENGTH, &json) != napi_ok) {
+    return false;
+  }
+
+  return node_string_into_roc_bytes(env, json, result) == napi_ok;
+}
+
+// Roc lends `name` and `arg` to its effects, so this doesn't decrement them.
+// Run a host function on the thread that called Roc. If it fails, this returns
+// false with an exception pending.
+bool host_call(struct RocStr *name, struct RocBytes *arg,
+               struct RocBytes *result) {
+  napi_env env = host_env;
+  napi_handle_scope scope;
+  bool ok;
+
+  // Jumping back to roc_call_guarded from in here would leave the handle scope
+  // open, so if the function's answer doesn't fit within the memory limit,
+  // have roc_alloc return NULL, and converting the answer throw a RangeError,
+  // like it does when Roc runs on its own thread.
+  bool was_jump_on_crash_set = jump_on_crash_set;
+
+  jump_on_crash_set = false;
+
+  // Roc might call host functions in a loop, so don't let the values each
+  // call creates pile up until callRoc returns.
+  if (napi_open_handle_scope(env, &scope) != napi_ok) {
+    ok = false;
+  } else {
+    ok = call_host_function(env, *name, *arg, result);
+    napi_close_handle_scope(env, scope);
+  }
+
+  if (!ok) {
+    bool is_exception_pending = false;
+
+    napi_is_exception_pending(env, &is_exception_pending);
+
+    if (!is_exception_pending) {
+      napi_throw_error(env, NULL, "Roc couldn't call a host function");
+    }
+  }
+
+  jump_on_crash_set = was_jump_on_crash_set;
+
+  return ok;
+}
+
+// Roc lends `name` and `arg` to its effects, so this doesn't decrement them.
+struct RocBytes roc_fx_hostCall(struct RocStr *name, struct RocBytes *arg) {
+  sig_atomic_t was_running = enter_host();
+  struct RocBytes result;
+  uint64_t started = trace_now();
+
+#if ROC_STACK_SIZE > 0
+  bool ok = on_roc_thread ? roc_thread_host_call(name, arg, &result)
+                          : host_call(name, arg, &result);
+#else
+  bool ok = host_call(name, arg, &result);
+#endif
+
+  trace_event(ROC_TRACE_HOST_FUNCTION, started);
+
+  if (!ok) {
+    roc_code_running = 0;
+    last_crash_kind = ROC_CRASH_HOST_EXCEPTION;
+    last_signal = 0;
+    last_roc_crash_msg = NULL;
+
+    longjmp(jump_on_crash, 1);
+  }
+
+  leave_host(was_running);
+
+  return result;
+}
+
+struct RocJsonCall {
+  RocJsonEntryPoint entry_point;
+  const struct RocJsonEffect *effect;
+  struct RocBytes ret;
+  struct RocBytes arg;
+};
+
+void call_json_entry_point(void *data) {
+  struct RocJsonCall *call = (struct RocJsonCall *)data;
+
+  if (call->effect == NULL) {
+    call->entry_point(&call->ret, &call->arg);
+
+    return;
+  }
+
+  // mainForHost returns an Effect, which is a closure; get the closure, and
+  // then run it.
+  uint8_t unit = 0;
+  int64_t size = call->effect->size();
+  void *closure = alloca(size > 0 ? (size_t)size : 1);
+
+  ((void (*)(void *, struct RocBytes *))call->entry_point)(closure, &call->arg);
+  call->effect->caller(&unit, closure, &call->ret);
+}
+
+// Memoization
+//
+// Roc functions are pure, so when the same JSON goes into a pure mainForHost
+// (one that doesn't return an Effect, and so can't call host functions), the
+// same JSON comes out. Built with the `memoize` option, callRoc keeps a bounded
+// LRU cache of Roc's answers, keyed by a hash of the argument's JSON, so that
+// repeated arguments skip stringifying into Roc memory and calling Roc. The
+// cache holds the reference to each answer that Roc returned, and decrements
+// it when the answer gets evicted.
+
+// The maximum number of answers to keep (0 means don't memoize at all), and
+// the maximum number of bytes they (and their keys) may take up.
+#ifndef ROC_MEMO_MAX_ENTRIES
+#define ROC_MEMO_MAX_ENTRIES 0
+#endif
+
+#ifndef ROC_MEMO_MAX_BYTES
+#define ROC_MEMO_MAX_BYTES (64 * 1024 * 1024)
+#endif
+
+struct MemoEntry {
+  // The hash table's chain, and the LRU list (newest first).
+  struct MemoEntry *next_in_bucket;
+  struct MemoEntry *newer;
+  struct MemoEntry *older;
+  // Different modules' entry points can get the same JSON (with
+  // sharedRuntime, they share this cache), so the entry point is part of the
+  // key.
+  RocJsonEntryPoint entry_point;
+  uint64_t hash;
+  uint8_t *key;
+  size_t key_len;
+  struct RocBytes answer;
+  // What this entry counts toward ROC_MEMO_MAX_BYTES.
+  size_t size;
+};
+
+struct Memo {
+  struct MemoEntry **buckets;
+  size_t bucket_count;
+  struct MemoEntry *newest;
+  struct MemoEntry *oldest;
+  size_t entries;
+  size_t bytes;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+};
+
+struct Memo memo = {0};
+
+#if ROC_MEMO_MAX_ENTRIES > 0
+// wyhash (final version 4, by Wang Yi, released into the public domain),
+// which is about as fast as hashing gets for keys of every length.
+void wymum(uint64_t *a, uint64_t *b) {
+#ifdef __SIZEOF_INT128__
+  unsigned __int128 product = (unsigned __int128)*a * *b;
+
+  *a = (uint64_t)product;
+  *b = (uint64_t)(product >> 64);
+#else
+  // The same 64x64 -> 128-bit multiply, for compilers without __int128 (e.g.
+  // for 32-bit x86), from the 32-bit halves of each side.
+  uint64_t a_high = *a >> 32, a_low = (uint32_t)*a;
+  uint64_t b_high = *b >> 32, b_low = (uint32_t)*b;
+  uint64_t high = a_high * b_high, middle0 = a_high * b_low;
+  uint64_t middle1 = b_high * a_low, low = a_low * b_low;
+  uint64_t sum = low + (middle0 << 32), carry = sum < low;
+  uint64_t product_low = sum + (middle1 << 32);
+
+  carry += product_low < sum;
+  *a = product_low;
+  *b = high + (middle0 >> 32) + (middle1 >> 32) + carry;
+#endif
+}
+
+uint64_t wymix(uint64_t a, uint64_t b) {
+  wymum(&a, &b);
+
+  return a ^ b;
+}
+
+uint64_t wyr8(const uint8_t *p) {
+  uint64_t v;
+
+  memcpy(&v, p, 8);
+
+  return v;
+}
+
+uint64_t wyr4(const uint8_t *p) {
+  uint32_t v;
+
+  memcpy(&v, p, 4);
+
+  return v;
+}
+
+uint64_t wyr3(const uint8_t *p, size_t k) {
+  return (((uint64_t)p[0]) << 16) | (((uint64_t)p[k >> 1]) << 8) | p[k - 1];
+}
+
+const uint64_t wyp[4] = {0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+                         0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull};
+
+uint64_t wyhash(const uint8_t *p, size_t len, uint64_t seed) {
+  uint64_t a;
+  uint64_t b;
+
+  seed ^= wymix(seed ^ wyp[0], wyp[1]);
+
+  if (len <= 16) {
+    if (len >= 4) {
+      a = (wyr4(p) << 32) | wyr4(p + ((len >> 3) << 2));
+      b = (wyr4(p + len - 4) << 32) | wyr4(p + len - 4 - ((len >> 3) << 2));
+    } else if (len > 0) {
+      a = wyr3(p, len);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+
+    if (i >= 48) {
+      uint64_t see1 = seed;
+      uint64_t see2 = seed;
+
+      do {
+        seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+        see1 = wymix(wyr8(p + 16) ^ wyp[2], wyr8(p + 24) ^ see1);
+        see2 = wymix(wyr8(p + 32) ^ wyp[3], wyr8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i >= 48);
+
+      seed ^= see1 ^ see2;
+    }
+
+    while (i > 16) {
+      seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+
+    a = wyr8(p + i - 16);
+    b = wyr8(p + i - 8);
+  }
+
+  a ^= wyp[1];
+  b ^= seed;
+  wymum(&a, &b);
+
+  return wymix(a ^ wyp[0] ^ len, b ^ wyp[1]);
+}
+
+struct MemoEntry **memo_bucket(uint64_t hash) {
+  return &memo.buckets[hash & (memo.bucket_count - 1)];
+}
+
+void memo_unlink(struct MemoEntry *entry) {
+  if (entry->newer != NULL) {
+    entry->newer->older = entry->older;
+  } else {
+    memo.newest = entry->older;
+  }
+
+  if (entry->older != NULL) {
+    entry->older->newer = entry->newer;
+  } else {
+    memo.oldest = entry->newer;
+  }
+}
+
+void memo_link_newest(struct MemoEntry *entry) {
+  entry->newer = NULL;
+  entry->older = memo.newest;
+
+  if (memo.newest != NULL) {
+    memo.newest->newer = entry;
+  } else {
+    memo.oldest = entry;
+  }
+
+  memo.newest = entry;
+}
+
+struct MemoEntry *memo_find(RocJsonEntryPoint entry_point, uint64_t hash,
+                            const uint8_t *key, size_t key_len) {
+  if (memo.buckets == NULL) {
+    return NULL;
+  }
+
+  for (struct MemoEntry *entry = *memo_bucket(hash); entry != NULL;
+       entry = entry->next_in_bucket) {
+    if (entry->hash == hash && entry->entry_point == entry_point &&
+        entry->key_len == key_len && memcmp(entry->key, key, key_len) == 0) {
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+void memo_remove(struct MemoEntry *entry) {
+  struct MemoEntry **link = memo_bucket(entry->hash);
+
+  while (*link != entry) {
+    link = &(*link)->next_in_bucket;
+  }
+
+  *link = entry->next_in_bucket;
+  memo_unlink(entry);
+
+  memo.entries--;
+  memo.bytes -= entry->size;
+
+  decref_roc_bytes(entry->answer);
+  free(entry->key);
+  free(entry);
+}
+
+// Cache `answer` (taking over its reference, and `key`) if it fits, evicting
+// the least recently used answers to make room. Returns false if it doesn't
+// fit, in which case the caller still owns both.
+bool memo_insert(RocJsonEntryPoint entry_point, uint64_t hash, uint8_t *key,
+                 size_t key_len, struct RocBytes answer) {
+  size_t size = sizeof(struct MemoEntry) + key_len + roc_bytes_len(answer);
+
+  if (size > ROC_MEMO_MAX_BYTES) {
+    return false;
+  }
+
+  if (memo.buckets == NULL) {
+    // A power of two, with room for the table to stay at most half full.
+    size_t bucket_count = 1;
+
+    while (bucket_count < 2 * (size_t)ROC_MEMO_MAX_ENTRIES) {
+      bucket_count *= 2;
+    }
+
+    memo.buckets = calloc(bucket_count, sizeof(struct MemoEntry *));
+
+    if (memo.buckets == NULL) {
+      return false;
+    }
+
+    memo.bucket_count = bucket_count;
+  }
+
+  struct MemoEntry *entry = malloc(sizeof(struct MemoEntry));
+
+  if (entry == NULL) {
+    return false;
+  }
+
+  while (memo.oldest != NULL && (memo.entries >= ROC_MEMO_MAX_ENTRIES ||
+                                 memo.bytes + size > ROC_MEMO_MAX_BYTES)) {
+    memo_remove(memo.oldest);
+    memo.evictions++;
+  }
+
+  struct MemoEntry **bucket = memo_bucket(hash);
+
+  entry->next_in_bucket = *bucket;
+  entry->entry_point = entry_point;
+  entry->hash = hash;
+  entry->key = key;
+  entry->key_len = key_len;
+  entry->answer = answer;
+  entry->size = size;
+
+  *bucket = entry;
+  memo_link_newest(entry);
+
+  memo.entries++;
+  memo.bytes += size;
+
+  return true;
+}
+
+// Like call_roc_json from its JSON.stringify on, but looking up the argument's
+// JSON in the cache first, and caching Roc's answer on a miss.
+napi_value call_roc_json_memoized(napi_env env, napi_value options,
+                                  RocJsonEntryPoint entry_point,
+                                  napi_value node_json_string) {
+  size_t len;
+  struct RocTimeouts timeouts;
+
+  // A cached answer doesn't need the timeouts, but invalid options should
+  // throw either way.
+  if (!read_timeouts(env, options, &timeouts) ||
+      napi_get_value_string_utf8(env, node_json_string, NULL, 0, &len) !=
+          napi_ok) {
+    return NULL;
+  }
+
+  // napi_get_value_string_utf8 always writes a null terminator.
+  uint8_t *key = malloc(len + 1);
+
+  if (key == NULL) {
+    napi_throw_range_error(env, NULL,
+                           "Out of memory copying the argument to callRoc");
+
+    return NULL;
+  }
+
+  if (napi_get_value_string_utf8(env, node_json_string, (char *)key, len + 1,
+                                 &len) != napi_ok) {
+    free(key);
+
+    return NULL;
+  }
+
+  uint64_t started = trace_now();
+  uint64_t hash = wyhash(key, len, (uint64_t)(uintptr_t)entry_point);
+  struct MemoEntry *entry = memo_find(entry_point, hash, key, len);
+
+  if (entry != NULL) {
+    memo.hits++;
+    free(key);
+
+    memo_unlink(entry);
+    memo_link_newest(entry);
+
+    node_json_string = roc_bytes_as_node_string(env, entry->answer);
+
+    trace_event(ROC_TRACE_MEMO_HIT, started);
+  } else {
+    struct RocJsonCall call = {.entry_point = entry_point};
+
+    memo.misses++;
+
+    if (!roc_call_begin(env)) {
+      free(key);
+
+      return NULL;
+    }
+
+    if (!init_roc_bytes(key, len, len, &call.arg)) {
+      throw_out_of_memory(env);
+      roc_call_abort();
+      free(key);
+
+      return NULL;
+    }
+
+    if (!roc_call_run(env, options, call_json_entry_point, &call)) {
+      free(key);
+
+      return NULL;
+    }
+
+    if (memo_insert(entry_point, hash, key, len, call.ret)) {
+      node_json_string = roc_bytes_as_node_string(env, call.ret);
+    } else {
+      free(key);
+      node_json_string = roc_bytes_into_node_string(env, call.ret);
+    }
+
+    roc_call_end();
+  }
+
+  napi_value answer;
+
+  if (node_json_string == NULL) {
+    return NULL;
+  }
+
+  started = trace_now();
+
+  if (call_json(env, "parse", node_json_string, &answer) != napi_ok) {
+    return NULL;
+  }
+
+  trace_event(ROC_TRACE_PARSE, started);
+
+  return answer;
+}
+
+// Drop every cached answer (but keep counting hits, misses, and evictions).
+napi_value clear_memo(napi_env env, napi_callback_info info) {
+  while (memo.oldest != NULL) {
+    memo_remove(memo.oldest);
+  }
+
+  return NULL;
+}
+#else
+napi_value clear_memo(napi_env env, napi_callback_info info) { return NULL; }
+#endif
+
+// { hits, misses, evictions, entries, bytes } for the cache. (These are all 0
+// unless the addon was built with the `memoize` option.)
+napi_value get_memo_stats(napi_env env, napi_callback_info info) {
+  const char *names[] = {"hits", "misses", "evictions", "entries", "bytes"};
+  double values[] = {(double)memo.hits, (double)memo.misses,
+                     (double)memo.evictions, (double)memo.entries,
+                     (double)memo.bytes};
+  napi_value stats;
+
+  if (napi_create_object(env, &stats) != napi_ok) {
+    return NULL;
+  }
+
+  for (size_t index = 0; index < sizeof(names) / sizeof(names[0]); index++) {
+    napi_value value;
+
+    if (napi_create_double(env, values[index], &value) != napi_ok ||
+        napi_set_named_property(env, stats, names[index], value) != napi_ok) {
+      return NULL;
+    }
+  }
+
+  return stats;
+}
+
+// Receive a value from Node and pass it to Roc as JSON, then convert Roc's
+// JSON answer back into a Node value.
+napi_value call_roc_json(napi_env env, napi_callback_info info,
+                         RocJsonEntryPoint entry_point,
+                         const struct RocJsonEffect *effect) {
+  napi_value node_json_string;
+  napi_value functions;
+  size_t argc = 2;
+  napi_value argv[2];
+
+  // If fewer arguments were passed than we asked for, napi_get_cb_info fills
+  // in the rest with `undefined`, so argv[1] (the options) is always there.
+  if (napi_get_cb_info(env, info, &argc, argv, NULL, NULL) != napi_ok) {
+    return NULL;
+  }
+
+  if (get_host_functions(env, argv[1], &functions) != napi_ok) {
+    napi_throw_type_error(env, NULL,
+                          "callRoc expects its hostFunctions option to be an "
+                          "object whose properties are functions");
+
+    return NULL;
+  }
+
+  uint64_t started = trace_now();
+
+  if (call_json(env, "stringify", argv[0], &node_json_string) != napi_ok) {
+    return NULL;
+  }
+
+  trace_event(ROC_TRACE_STRINGIFY, started);
+
+#if ROC_MEMO_MAX_ENTRIES > 0
+  if (effect == NULL) {
+    return call_roc_json_memoized(env, argv[1], entry_point, node_json_string);
+  }
+#endif
+
+  struct RocJsonCall call = {.entry_point = entry_point, .effect = effect};
+
+  if (!roc_call_begin(env)) {
+    return NULL;
+  }
+
+  // Translate the JSON string into a Roc List U8
+  if (node_string_into_roc_bytes(env, node_json_string, &call.arg) != napi_ok) {
+    roc_call_abort();
+
+    return NULL;
+  }
+
+  // Call the Roc function to populate `call.ret`'s bytes.
+  host_env = env;
+  host_functions = functions;
+
+  bool succeeded = roc_call_run(env, argv[1], call_json_entry_point, &call);
+
+  host_env = NULL;
+  host_functions = NULL;
+
+  if (!succeeded) {
+    return NULL;
+  }
+
+  // Consume that List U8 to create the Node string.
+  node_json_string = roc_bytes_into_node_string(env, call.ret);
+
+  roc_call_end();
+
+  // Call JSON.parse on what we got back from Roc
+  napi_value answer;
+
+  started = trace_now();
+
+  if (call_json(env, "parse", node_json_string, &answer) != napi_ok) {
+    return NULL;
+  }
+
+  trace_event(ROC_TRACE_PARSE, started);
+
+  return answer;
+}
+
+// Streaming
+//
+// For inputs too big to pass to callRoc in one piece, the module's streamRoc
+// drives a platform's stream entry points (see struct RocJsonStream) with
+// these: startRocStream, then stepRocStream for each chunk, then
+// finishRocStream. Each is a call of its own, so its memory limit and timeouts
+// apply to one chunk at a time, and whatever Roc retains in its state between
+// chunks outlives the call that allocated it like any other retained value.
+
+// A stream in progress. `state` is NULL once the stream has finished, or once
+// Roc has crashed part way through a step. (Roc had taken over the state by
+// then, so there's no telling what of it is still allocated, and it can't be
+// freed.)
+struct RocStream {
+  const struct RocJsonStream *entry_points;
+  void *state;
+};
+
+struct RocStreamCall {
+  const struct RocJsonStream *entry_points;
+  void *state;
+  struct RocBytes arg;
+  void *next_state;
+  struct RocBytes ret;
+};
+
+void call_stream_init(void *data) {
+  struct RocStreamCall *call = (struct RocStreamCall *)data;
+
+  call->entry_points->init(&call->next_state, &call->arg);
+}
+
+void call_stream_step(void *data) {
+  struct RocStreamCall *call = (struct RocStreamCall *)data;
+
+  call->entry_points->step(&call->next_state, call->state, &call->arg);
+}
+
+void call_stream_done(void *data) {
+  struct RocStreamCall *call = (struct RocStreamCall *)data;
+
+  call->entry_points->done(&call->ret, call->state);
+}
+
+// A stream that gets garbage collected without having finished keeps its
+// state allocated, since only Roc knows how to free it. streamRoc always
+// finishes its streams, even when the input fails part way through.
+void finalize_roc_stream(napi_env env, void *data, void *hint) { free(data); }
+
+// Get the stream that startRocStream returned, throwing if it's finished.
+napi_status get_roc_stream(napi_env env, napi_value handle,
+                           struct RocStream **out) {
+  napi_valuetype type;
+  void *data;
+
+  if (napi_typeof(env, handle, &type) != napi_ok || type != napi_external ||
+      napi_get_value_external(env, handle, &data) != napi_ok) {
+    napi_throw_type_error(env, NULL, "Expected a stream from startRocStream");
+
+    return napi_pending_exception;
+  }
+
+  *out = (struct RocStream *)data;
+
+  if ((*out)->state == NULL) {
+    napi_throw_error(env, NULL,
+                     "This Roc stream has already finished (or crashed)");
+
+    return napi_pending_exception;
+  }
+
+  return napi_ok;
+}
+
+// startRocStream(arg, options): pass `arg` to initForHost as JSON, and return
+// a handle on the stream, which holds the state Roc returned.
+napi_value start_roc_stream(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  void *entry_points;
+  napi_value json;
+  napi_value handle;
+
+  if (napi_get_cb_info(env, info, &argc, argv, NULL, &entry_points) !=
+          napi_ok ||
+      call_json(env, "stringify", argv[0], &json) != napi_ok) {
+    return NULL;
+  }
 
-  // If allocation failed, bail out.
-  if (buf == NULL) {
-    fprintf(stderr, "WARNING: roc_alloc failed during node_string_into_roc_bytes in nodeJS\n");
-    return napi_generic_failure;
+  struct RocStream *stream = malloc(sizeof(struct RocStream));
+
+  if (stream == NULL) {
+    napi_throw_error(env, NULL, "Not enough memory to start a Roc stream");
+
+    return NULL;
   }
 
-  // This writes the actual number of bytes copied into len. Theoretically
-  // they should be the same, but it could be different if the buffer was
-  // somehow smaller. This way we guarantee that the RocBytes does not present
-  // any memory garbage to the user.
-  status =
-      napi_get_value_string_utf8(env, node_string, (char *)buf, capacity, &len);
+  stream->entry_points = (const struct RocJsonStream *)entry_points;
+  stream->state = NULL;
 
-  if (status != napi_ok) {
-    // Something went wrong, so free the bytes we just allocated before
-    // returning.
-    roc_dealloc((void *)buf, __alignof__(char *));
+  if (napi_create_external(env, stream, finalize_roc_stream, NULL, &handle) !=
+      napi_ok) {
+    free(stream);
 
-    return status;
+    return NULL;
   }
 
-  *roc_bytes = init_roc_bytes(buf, len, capacity);
+  struct RocStreamCall call = {.entry_points = stream->entry_points};
 
-  return status;
+  if (!roc_call_begin(env)) {
+    return NULL;
+  }
+
+  if (node_string_into_roc_bytes(env, json, &call.arg) != napi_ok) {
+    roc_call_abort();
+
+    return NULL;
+  }
+
+  if (!roc_call_run(env, argv[1], call_stream_init, &call)) {
+    return NULL;
+  }
+
+  stream->state = call.next_state;
+  roc_call_end();
+
+  return handle;
 }
 
-// Consume the given RocStr (decrement its refcount) after creating a Node
-// string from it.
-napi_value roc_str_into_node_string(napi_env env, struct RocStr roc_str) {
-  bool is_small = is_small_str(roc_str);
-  char *roc_str_contents;
+// stepRocStream(stream, chunk, options): pass the state and the next chunk (a
+// Uint8Array) to stepForHost, and hold on to the state it returns.
+napi_value step_roc_stream(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value argv[3];
+  struct RocStream *stream;
+  napi_value undefined;
+
+  if (napi_get_cb_info(env, info, &argc, argv, NULL, NULL) != napi_ok ||
+      get_roc_stream(env, argv[0], &stream) != napi_ok ||
+      napi_get_undefined(env, &undefined) != napi_ok) {
+    return NULL;
+  }
 
-  if (is_small) {
-    // In a small string, the string itself contains its contents.
-    roc_str_contents = (char *)&roc_str;
-  } else {
-    roc_str_contents = (char *)roc_str.bytes;
+  struct RocStreamCall call = {.entry_points = stream->entry_points,
+                               .state = stream->state};
+
+  if (!roc_call_begin(env)) {
+    return NULL;
   }
 
-  napi_value answer;
+  if (node_into_roc_bytes(env, argv[1], 1, &call.arg) != napi_ok) {
+    roc_call_abort();
 
-  if (napi_create_string_utf8(env, roc_str_contents, roc_str_len(roc_str),
-                              &answer) != napi_ok) {
-    answer = NULL;
+    return NULL;
   }
 
-  // Decrement the RocStr because we consumed it.
-  if (!is_small) {
-    decref_large_str(roc_str);
+  // From here on, the state belongs to Roc.
+  stream->state = NULL;
+
+  if (!roc_call_run(env, argv[2], call_stream_step, &call)) {
+    return NULL;
   }
 
-  return answer;
+  stream->state = call.next_state;
+  roc_call_end();
+
+  return undefined;
 }
 
-// Consume the given RocBytes (decrement its refcount) after creating a Node
-// string from it. (Assume we know these are UTF-8 bytes.)
-napi_value roc_bytes_into_node_string(napi_env env, struct RocBytes roc_bytes) {
-  napi_value answer;
+// finishRocStream(stream, options): pass the final state to doneForHost, and
+// JSON.parse its answer.
+napi_value finish_roc_stream(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  struct RocStream *stream;
 
-  if (napi_create_string_utf8(env, (char *)roc_bytes.bytes, roc_bytes.len,
-                              &answer) != napi_ok) {
-    answer = NULL;
+  if (napi_get_cb_info(env, info, &argc, argv, NULL, NULL) != napi_ok ||
+      get_roc_stream(env, argv[0], &stream) != napi_ok) {
+    return NULL;
   }
 
-  // Decrement the RocStr because we consumed it.
-  decref_roc_bytes(roc_bytes);
+  struct RocStreamCall call = {.entry_points = stream->entry_points,
+                               .state = stream->state};
 
-  return answer;
-}
+  if (!roc_call_begin(env)) {
+    return NULL;
+  }
 
-// Create a Node string from the given RocStr.
-// Don't decrement the RocStr's refcount. (To decrement it, use
-// roc_str_into_node_string instead.)
-napi_value roc_str_as_node_string(napi_env env, struct RocStr roc_str) {
-  bool is_small = is_small_str(roc_str);
-  char *roc_str_contents;
+  stream->state = NULL;
 
-  if (is_small) {
-    // In a small string, the string itself contains its contents.
-    roc_str_contents = (char *)&roc_str;
-  } else {
-    roc_str_contents = (char *)roc_str.bytes;
+  if (!roc_call_run(env, argv[1], call_stream_done, &call)) {
+    return NULL;
   }
 
-  napi_status status;
+  napi_value json = roc_bytes_into_node_string(env, call.ret);
   napi_value answer;
 
-  status = napi_create_string_utf8(env, roc_str_contents, roc_str_len(roc_str),
-                                   &answer);
+  roc_call_end();
 
-  if (status != napi_ok) {
+  if (call_json(env, "parse", json, &answer) != napi_ok) {
     return NULL;
   }
 
-  // Do not decrement the RocStr's refcount because we did not consume it.
-
   return answer;
 }
 
-// Create a C string from the given RocStr. Don't reuse memory; do a fresh
-// malloc for it. Don't decrement the RocStr's refcount. (To decrement it, use
-// roc_str_into_c_string instead.)
-char *roc_str_into_c_string(struct RocStr roc_str) {
-  char *roc_str_contents;
-  size_t len;
-  bool is_small = is_small_str(roc_str);
+napi_status export_json_stream(napi_env env, napi_value exports,
+                               const struct RocJsonStream *stream) {
+  void *data = (void *)stream;
+  napi_status status = export_function_with_data(
+      env, exports, "startRocStream", start_roc_stream, data);
 
-  if (is_small) {
-    // In a small string, the string itself contains its contents.
-    roc_str_contents = (char *)&roc_str;
-    len = roc_str_len_small(roc_str);
-  } else {
-    roc_str_contents = (char *)roc_str.bytes;
-    len = roc_str_len_big(roc_str);
+  if (status == napi_ok) {
+    status = export_function(env, exports, "stepRocStream", step_roc_stream);
   }
 
-  char *buf = (char *)malloc(len + 1); // leave room for the \0 at the end
+  if (status == napi_ok) {
+    status =
+        export_function(env, exports, "finishRocStream", finish_roc_stream);
+  }
 
-  // Copy the bytes from the string into the buffer
-  memcpy(buf, roc_str_contents, len);
+  return status;
+}
 
-  // Write the \0 at the end
-  buf[len] = '\0';
+// Set the maximum number of bytes a single call may have allocated at once.
+// 0 means unlimited.
+napi_value set_memory_limit(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  double limit;
 
-  // Decrement the RocStr because we consumed it.
-  if (!is_small) {
-    decref_large_str(roc_str);
+  if (napi_get_cb_info(env, info, &argc, argv, NULL, NULL) != napi_ok) {
+    return NULL;
   }
 
-  return buf;
-}
+  if (argc < 1 || napi_get_value_double(env, argv[0], &limit) != napi_ok ||
+      !(limit >= 0)) {
+    napi_throw_type_error(env, NULL,
+                          "setMemoryLimit expects a non-negative number of bytes");
 
-void roc_panic(struct RocStr *roc_str) {
-  last_signal = 0;
-  last_roc_crash_msg = roc_str_into_c_string(*roc_str);
+    return NULL;
+  }
 
-  longjmp(jump_on_crash, 1);
+  memory_limit = (size_t)limit;
+
+  return NULL;
 }
 
-extern void roc__mainForHost_1_exposed_generic(struct RocBytes *ret,
-                                               struct RocBytes *arg);
+// { liveBytes, liveAllocations, totalAllocations } for what Roc (and the
+// bridge, on Roc's behalf) has allocated: the bytes and allocations that
+// haven't been freed yet, and how many allocations there have ever been. If
+// calls don't leak, the live counts come back to the same values after each
+// call that doesn't keep anything (e.g. in a memo cache).
+napi_value get_allocator_stats(napi_env env, napi_callback_info info) {
+  const char *names[] = {"liveBytes", "liveAllocations", "totalAllocations"};
 
-// Receive a string value from Node and pass it to Roc as a RocStr, then get a
-// RocStr back from Roc and convert it into a Node string.
-napi_value call_roc(napi_env env, napi_callback_info info) {
-  // Set the jump point so we can recover from a segfault.
-  if (setjmp(jump_on_crash) == 0) {
-    // This is *not* the result of a longjmp
+  lock_allocations();
 
-    // Get the argument passed to the Node function
-    napi_value global, json, stringify, arg_buf[1], node_json_string;
-    size_t argc = 1;
-    napi_value argv[1];
+  double values[] = {(double)live_bytes, (double)live_allocations,
+                     (double)total_allocations};
 
-    napi_status status = napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+  unlock_allocations();
 
-    if (status != napi_ok) {
+  napi_value stats;
+
+  if (napi_create_object(env, &stats) != napi_ok) {
+    return NULL;
+  }
+
+  for (size_t index = 0; index < sizeof(names) / sizeof(names[0]); index++) {
+    napi_value value;
+
+    if (napi_create_double(env, values[index], &value) != napi_ok ||
+        napi_set_named_property(env, stats, names[index], value) != napi_ok) {
       return NULL;
     }
+  }
 
-    // Call JSON.stringify(node_arg)
+  return stats;
+}
 
-    // Get the global object
-    if (napi_get_global(env, &global) != napi_ok) {
-      return NULL;
+#ifdef ROC_HEAP_PROFILE
+// A growable string that the profile reports get written into.
+struct TextBuffer {
+  char *bytes;
+  size_t len;
+  size_t capacity;
+};
+
+bool text_printf(struct TextBuffer *buf, const char *format, ...) {
+  for (;;) {
+    va_list args;
+    size_t available = buf->capacity - buf->len;
+
+    va_start(args, format);
+    int written = vsnprintf(buf->bytes + buf->len, available, format, args);
+    va_end(args);
+
+    if (written < 0) {
+      return false;
     }
 
-    // global.JSON
-    if (napi_get_named_property(env, global, "JSON", &json) != napi_ok) {
-      return NULL;
+    if ((size_t)written < available) {
+      buf->len += written;
+
+      return true;
     }
 
-    // global.JSON.stringify
-    if (napi_get_named_property(env, json, "stringify", &stringify) !=
-        napi_ok) {
-      return NULL;
+    size_t new_capacity = (buf->capacity + written + 1) * 2;
+    char *new_bytes = realloc(buf->bytes, new_capacity);
+
+    if (new_bytes == NULL) {
+      return false;
     }
 
-    // Populate stringify's args
-    napi_value node_arg = argv[0];
+    buf->bytes = new_bytes;
+    buf->capacity = new_capacity;
+  }
+}
 
-    arg_buf[0] = node_arg;
+// The nearest symbol dladdr can find for this address. Roc's own functions are
+// usually local symbols that dladdr can't see, in which case this names the
+// closest exported symbol before it; the pprof format (which pprof symbolizes
+// using the full symbol table) doesn't have that problem.
+bool print_symbol(struct TextBuffer *buf, void *address) {
+  Dl_info info;
+
+  if (address != NULL && dladdr(address, &info) != 0) {
+    if (info.dli_sname != NULL) {
+      return text_printf(buf, "%s+0x%lx", info.dli_sname,
+                         (unsigned long)((char *)address -
+                                         (char *)info.dli_saddr));
+    }
 
-    // Call JSON.stringify
-    if (napi_call_function(env, json, stringify, 1, arg_buf,
-                           &node_json_string) != napi_ok) {
-      return NULL;
+    if (info.dli_fname != NULL) {
+      const char *file_name = strrchr(info.dli_fname, '/');
+
+      return text_printf(
+          buf, "%s+0x%lx", file_name == NULL ? info.dli_fname : file_name + 1,
+          (unsigned long)((char *)address - (char *)info.dli_fbase));
     }
+  }
 
-    // Translate the JSON string into a Roc List U8
-    struct RocBytes roc_arg;
+  return address == NULL ? text_printf(buf, "[other]")
+                         : text_printf(buf, "0x%lx", (unsigned long)address);
+}
 
-    if (node_string_into_roc_bytes(env, node_json_string, &roc_arg) != napi_ok) {
-      return NULL;
+bool print_counts(struct TextBuffer *buf, struct HeapProfileCounts *counts) {
+  return text_printf(buf, "%llu: %llu [%llu: %llu]",
+                     (unsigned long long)counts->live_allocations,
+                     (unsigned long long)counts->live_bytes,
+                     (unsigned long long)counts->allocations,
+                     (unsigned long long)counts->allocated_bytes);
+}
+
+// The legacy gperftools heap profile format, which `pprof` reads.
+bool print_pprof_profile(struct TextBuffer *buf) {
+  struct HeapProfileCounts total = {0, 0, 0, 0};
+
+  for (size_t index = 0; index < heap_profile_site_count; index++) {
+    struct HeapProfileCounts *counts = &heap_profile_sites[index].counts;
+
+    total.allocations += counts->allocations;
+    total.allocated_bytes += counts->allocated_bytes;
+    total.live_allocations += counts->live_allocations;
+    total.live_bytes += counts->live_bytes;
+  }
+
+  if (!text_printf(buf, "heap profile: ") || !print_counts(buf, &total) ||
+      !text_printf(buf, " @ heap_v2/%lu\n",
+                   (unsigned long)ROC_HEAP_PROFILE_SAMPLE_BYTES)) {
+    return false;
+  }
+
+  for (size_t index = 0; index < heap_profile_site_count; index++) {
+    struct HeapProfileSite *site = &heap_profile_sites[index];
+
+    if (site->address == NULL ||
+        (site->counts.allocations == 0 && site->counts.live_allocations == 0)) {
+      continue;
+    }
+
+    if (!print_counts(buf, &site->counts) ||
+        !text_printf(buf, " @ 0x%lx\n", (unsigned long)site->address)) {
+      return false;
     }
+  }
 
-    struct RocBytes roc_ret;
+#ifdef __linux__
+  // pprof needs these to map the addresses back to symbols.
+  FILE *maps = fopen("/proc/self/maps", "r");
 
-    // Call the Roc function to populate `roc_ret`'s bytes.
-    roc__mainForHost_1_exposed_generic(&roc_ret, &roc_arg);
+  if (maps != NULL) {
+    char chunk[4096];
+    size_t read;
+    bool ok = text_printf(buf, "\nMAPPED_LIBRARIES:\n");
 
-    // Consume that List U8 to create the Node string.
-    node_json_string = roc_bytes_into_node_string(env, roc_ret);
+    while (ok && (read = fread(chunk, 1, sizeof(chunk), maps)) > 0) {
+      ok = text_printf(buf, "%.*s", (int)read, chunk);
+    }
 
-    napi_value parse;
+    fclose(maps);
 
-    // JSON.parse
-    if (napi_get_named_property(env, json, "parse", &parse) != napi_ok) {
-      return NULL;
+    return ok;
+  }
+#endif
+
+  return true;
+}
+
+// One line per allocation site, weighted by bytes allocated, for
+// flamegraph.pl, speedscope, and the like. Collapsed stacks go from the root
+// down, so the caller comes first and roc_alloc is the leaf.
+bool print_collapsed_profile(struct TextBuffer *buf) {
+  for (size_t index = 0; index < heap_profile_site_count; index++) {
+    struct HeapProfileSite *site = &heap_profile_sites[index];
+
+    if (site->counts.allocated_bytes == 0) {
+      continue;
     }
 
-    // Reuse the same arg_buf as last time
-    arg_buf[0] = node_json_string;
+    if (!print_symbol(buf, site->address) ||
+        !text_printf(buf, ";roc_alloc %llu\n",
+                     (unsigned long long)site->counts.allocated_bytes)) {
+      return false;
+    }
+  }
 
-    // Call JSON.parse on what we got back from Roc
-    napi_value answer;
+  return true;
+}
 
-    if (napi_call_function(env, json, parse, 1, arg_buf, &answer) != napi_ok) {
-      return NULL;
+// The size histogram, one line per size class that has seen an allocation.
+bool print_size_histogram(struct TextBuffer *buf) {
+  if (!text_printf(buf, "size allocations bytes live_allocations live_bytes\n")) {
+    return false;
+  }
+
+  for (size_t size_class = 0; size_class < HEAP_PROFILE_SIZE_CLASSES;
+       size_class++) {
+    struct HeapProfileCounts *counts = &heap_profile_sizes[size_class];
+
+    if (counts->allocations == 0 && counts->live_allocations == 0) {
+      continue;
     }
 
-    return answer;
-  } else {
-    // This *is* the result of a longjmp
-    char *msg = last_roc_crash_msg != NULL ? (char *)last_roc_crash_msg
-                                           : strsignal(last_signal);
-    char *suffix =
-        " while running `main` in a .roc file";
-    char *buf =
-        malloc(strlen(msg) + strlen(suffix) + 1); // +1 for the null terminator
+    size_t min_size = size_class == 0 ? 0 : (size_t)1 << (size_class - 1);
+    size_t max_size = size_class == 0 ? 0 : min_size + (min_size - 1);
 
-    strcpy(buf, msg);
-    strcat(buf, suffix);
+    if (!text_printf(buf, "%lu-%lu %llu %llu %llu %llu\n",
+                     (unsigned long)min_size, (unsigned long)max_size,
+                     (unsigned long long)counts->allocations,
+                     (unsigned long long)counts->allocated_bytes,
+                     (unsigned long long)counts->live_allocations,
+                     (unsigned long long)counts->live_bytes)) {
+      return false;
+    }
+  }
 
-    napi_throw_error(env, NULL, buf);
+  return true;
+}
 
-    free(buf);
+// Return the heap profile as text, in the given format: "pprof" (the default),
+// "collapsed", or "sizes".
+napi_value get_heap_profile(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  char format[16] = "pprof";
+  napi_valuetype format_type = napi_undefined;
+
+  if (napi_get_cb_info(env, info, &argc, argv, NULL, NULL) != napi_ok) {
+    return NULL;
+  }
+
+  if (argc >= 1 && napi_typeof(env, argv[0], &format_type) != napi_ok) {
+    return NULL;
+  }
+
+  if (format_type != napi_undefined &&
+      (format_type != napi_string ||
+       napi_get_value_string_utf8(env, argv[0], format, sizeof(format), NULL) !=
+           napi_ok)) {
+    napi_throw_type_error(
+        env, NULL,
+        "getHeapProfile expects \"pprof\", \"collapsed\", or \"sizes\"");
+
+    return NULL;
+  }
+
+  struct TextBuffer buf = {NULL, 0, 0};
+  bool ok;
+
+  lock_allocations();
+
+  if (strcmp(format, "pprof") == 0) {
+    ok = print_pprof_profile(&buf);
+  } else if (strcmp(format, "collapsed") == 0) {
+    ok = print_collapsed_profile(&buf);
+  } else if (strcmp(format, "sizes") == 0) {
+    ok = print_size_histogram(&buf);
+  } else {
+    unlock_allocations();
+    napi_throw_type_error(
+        env, NULL,
+        "getHeapProfile expects \"pprof\", \"collapsed\", or \"sizes\"");
 
     return NULL;
   }
+
+  unlock_allocations();
+
+  napi_value result = NULL;
+
+  if (!ok) {
+    napi_throw_error(env, NULL, "Ran out of memory writing the heap profile");
+  } else if (napi_create_string_utf8(env, buf.len == 0 ? "" : buf.bytes,
+                                     buf.len, &result) != napi_ok) {
+    result = NULL;
+  }
+
+  free(buf.bytes);
+
+  return result;
 }
 
-napi_value init(napi_env env, napi_value exports) {
-  // Before doing anything else, install signal handlers in case subsequent C
-  // code causes any of these.
+// Forget everything allocated so far, apart from what's still live, so that
+// the next profile only covers what happens from here on (e.g. one call).
+napi_value reset_heap_profile(napi_env env, napi_callback_info info) {
+  lock_allocations();
+
+  for (size_t size_class = 0; size_class < HEAP_PROFILE_SIZE_CLASSES;
+       size_class++) {
+    heap_profile_sizes[size_class].allocations = 0;
+    heap_profile_sizes[size_class].allocated_bytes = 0;
+  }
+
+  for (size_t index = 0; index < heap_profile_site_count; index++) {
+    heap_profile_sites[index].counts.allocations = 0;
+    heap_profile_sites[index].counts.allocated_bytes = 0;
+  }
+
+  unlock_allocations();
+
+  return NULL;
+}
+#else
+napi_value heap_profiling_disabled(napi_env env, napi_callback_info info) {
+  napi_throw_error(env, NULL,
+                   "This .roc file was built without the `heapProfile` option, "
+                   "so it has no heap profile");
+
+  return NULL;
+}
+
+#define get_heap_profile heap_profiling_disabled
+#define reset_heap_profile heap_profiling_disabled
+#endif
+
+bool crash_handlers_installed = false;
+
+void install_crash_handlers() {
+  // With the shared runtime, every module's addon calls this, but there's only
+  // one set of handlers to install.
+  if (crash_handlers_installed) {
+    return;
+  }
+
+  crash_handlers_installed = true;
+
   struct sigaction action;
   memset(&action, 0, sizeof(action));
   action.sa_handler = signal_handler;
 
+  // We leave the handler with longjmp rather than returning from it, so the
+  // kernel would never get to unblock the signal again. SA_NODEFER keeps it
+  // unblocked while the handler runs, so the next crash gets handled too.
+  // (sigsetjmp would also work, but it costs a syscall on every call.)
+  action.sa_flags = SA_NODEFER;
+
+#if ROC_STACK_SIZE > 0
+  // Overflowing the Roc thread's stack raises SIGSEGV, and the handler can't
+  // run on the stack that just overflowed, so that thread has an alternate one.
+  action.sa_flags |= SA_ONSTACK;
+#endif
+
   // Handle all the signals that could take out the Node process and translate
   // them to exceptions.
   sigaction(SIGSEGV, &action, NULL);
@@ -627,23 +4156,83 @@ napi_value init(napi_env env, napi_value exports) {
   sigaction(SIGFPE, &action, NULL);
   sigaction(SIGILL, &action, NULL);
 
-  // Create our Node functions and expose them from this module.
+  install_timeout_signal_handler();
+}
+
+// `data` is what napi_get_cb_info gives the callback as its data.
+napi_status export_function_with_data(napi_env env, napi_value exports,
+                                      const char *name, napi_callback callback,
+                                      void *data) {
   napi_status status;
   napi_value fn;
 
-  status = napi_create_function(env, NULL, 0, call_roc, NULL, &fn);
+  status = napi_create_function(env, NULL, 0, callback, data, &fn);
 
   if (status != napi_ok) {
+    return status;
+  }
+
+  return napi_set_named_property(env, exports, name, fn);
+}
+
+napi_status export_function(napi_env env, napi_value exports, const char *name,
+                            napi_callback callback) {
+  return export_function_with_data(env, exports, name, callback, NULL);
+}
+
+napi_value init_addon(napi_env env, napi_value exports, napi_callback call_roc) {
+  // Before doing anything else, install signal handlers in case subsequent C
+  // code causes any of these.
+  install_crash_handlers();
+
+  // Create our Node functions and expose them from this module.
+  if (call_roc != NULL &&
+      export_function(env, exports, "callRoc", call_roc) != napi_ok) {
     return NULL;
   }
 
-  status = napi_set_named_property(env, exports, "callRoc", fn);
+  if (export_function(env, exports, "setMemoryLimit", set_memory_limit) !=
+          napi_ok ||
+      export_function(env, exports, "getAllocatorStats",
+                      get_allocator_stats) != napi_ok) {
+    return NULL;
+  }
 
-  if (status != napi_ok) {
+  if (export_function(env, exports, "getHeapProfile", get_heap_profile) !=
+          napi_ok ||
+      export_function(env, exports, "resetHeapProfile", reset_heap_profile) !=
+          napi_ok) {
+    return NULL;
+  }
+
+  if (export_function(env, exports, "getMemoStats", get_memo_stats) !=
+          napi_ok ||
+      export_function(env, exports, "clearMemo", clear_memo) != napi_ok) {
+    return NULL;
+  }
+
+  if (export_function(env, exports, "drainTraceEvents", drain_trace_events) !=
+      napi_ok) {
     return NULL;
   }
 
   return exports;
 }
 
+#if defined(ROC_ESBUILD_RUNTIME)
+// This is the shared runtime, which owns allocation, crash handling, and
+// marshalling for every module's addon (see node-to-roc-module.c). It has no
+// Roc code of its own.
+napi_value init(napi_env env, napi_value exports) {
+  return init_addon(env, exports, NULL);
+}
+
 NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
+#elif !defined(ROC_ESBUILD_TYPED_GLUE)
+// A platform whose mainForHost takes and returns JSON. (Otherwise, the build
+// defines ROC_ESBUILD_TYPED_GLUE, and the C that node-glue.roc generated for
+// the platform's entry points defines the module instead.) Connecting its Roc
+// code to Node is the same as with the shared runtime, so that lives in one
+// place.
+#include "node-to-roc-module.c"
+#endif
@@ -0,0 +1,166 @@
+// Declarations shared between node-to-roc.c and the other C files that can be
+// linked into an addon alongside it (or alongside the shared runtime, which is
+// node-to-roc.c built with ROC_ESBUILD_RUNTIME).
+#ifndef NODE_TO_ROC_H
+#define NODE_TO_ROC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <node_api.h>
+
+// RocBytes (List U8)
+struct RocBytes {
+  uint8_t *bytes;
+  size_t len;
+  size_t capacity;
+};
+
+// RocStr
+struct RocStr {
+  uint8_t *bytes;
+  size_t len;
+  size_t capacity;
+};
+
+// The signature of roc__mainForHost_1_exposed_generic for platforms whose
+// mainForHost takes and returns JSON as a List U8.
+typedef void (*RocJsonEntryPoint)(struct RocBytes *ret, struct RocBytes *arg);
+
+// A platform whose mainForHost returns an Effect (List U8) rather than a
+// List U8, so that Roc can call host functions while it runs (see
+// roc_fx_hostCall), also exposes these for running the Effect.
+struct RocJsonEffect {
+  int64_t (*size)(void);
+  void (*caller)(const uint8_t *unit, void *closure, struct RocBytes *ret);
+};
+
+// Implement callRoc for the given entry point: JSON.stringify the argument,
+// pass it to Roc, and JSON.parse what Roc returns, turning crashes into
+// exceptions. `effect` is NULL unless mainForHost returns an Effect.
+napi_value call_roc_json(napi_env env, napi_callback_info info,
+                         RocJsonEntryPoint entry_point,
+                         const struct RocJsonEffect *effect);
+
+// A platform whose mainForHost takes and returns JSON can also provide these
+// three entry points, so that streamRoc can feed it an input in chunks rather
+// than all at once: initForHost turns JSON into the stream's initial state,
+// stepForHost takes a state and the next chunk and returns the next state, and
+// doneForHost turns the final state into a JSON answer. The state is a Box
+// (so, to the host, a pointer), which only Roc looks inside.
+struct RocJsonStream {
+  void (*init)(void **ret, struct RocBytes *arg);
+  void (*step)(void **ret, void *state, struct RocBytes *chunk);
+  void (*done)(struct RocBytes *ret, void *state);
+};
+
+// Export the functions streamRoc uses to drive the platform's stream entry
+// points (startRocStream, stepRocStream, and finishRocStream).
+napi_status export_json_stream(napi_env env, napi_value exports,
+                               const struct RocJsonStream *stream);
+
+// Calls into Roc go like this: roc_call_begin, convert the arguments (calling
+// roc_call_abort and returning if that fails), roc_call_run, convert the
+// return value, and roc_call_end. call_roc_json does exactly that.
+typedef void (*RocCall)(void *data);
+
+// Returns false (having thrown) if Roc is already running, i.e. this is a call
+// from one of the host functions Roc called.
+bool roc_call_begin(napi_env env);
+void roc_call_abort(void);
+
+// Run `call(data)` with the timeouts from callRoc's options (which may be
+// `undefined`) armed. If Roc crashes, this releases everything allocated since
+// roc_call_begin, throws, and returns false.
+bool roc_call_run(napi_env env, napi_value options, RocCall call, void *data);
+
+void roc_call_end(void);
+
+// Convert Node arguments into Roc values for typed entry points, throwing a
+// TypeError that names the argument (`index` counts from 0) if a value has the
+// wrong type, or a RangeError if it doesn't fit within the memory limit.
+napi_status node_into_roc_str(napi_env env, napi_value value, size_t index,
+                              struct RocStr *out);
+napi_status node_into_roc_bytes(napi_env env, napi_value value, size_t index,
+                                struct RocBytes *out);
+napi_status node_into_roc_bool(napi_env env, napi_value value, size_t index,
+                               bool *out);
+napi_status node_into_roc_i8(napi_env env, napi_value value, size_t index,
+                             int8_t *out);
+napi_status node_into_roc_u8(napi_env env, napi_value value, size_t index,
+                             uint8_t *out);
+napi_status node_into_roc_i16(napi_env env, napi_value value, size_t index,
+                              int16_t *out);
+napi_status node_into_roc_u16(napi_env env, napi_value value, size_t index,
+                              uint16_t *out);
+napi_status node_into_roc_i32(napi_env env, napi_value value, size_t index,
+                              int32_t *out);
+napi_status node_into_roc_u32(napi_env env, napi_value value, size_t index,
+                              uint32_t *out);
+napi_status node_into_roc_i64(napi_env env, napi_value value, size_t index,
+                              int64_t *out);
+napi_status node_into_roc_u64(napi_env env, napi_value value, size_t index,
+                              uint64_t *out);
+// Only where the C compiler has a 128-bit integer type (not e.g. 32-bit x86 or
+// wasm32); node-glue.roc's C refuses to compile without one if it needs these.
+#ifdef __SIZEOF_INT128__
+napi_status node_into_roc_i128(napi_env env, napi_value value, size_t index,
+                               __int128 *out);
+napi_status node_into_roc_u128(napi_env env, napi_value value, size_t index,
+                               unsigned __int128 *out);
+// A Dec is an I128 counting in units of 10^-18, so it's passed as that bigint.
+napi_status node_into_roc_dec(napi_env env, napi_value value, size_t index,
+                              __int128 *out);
+#endif
+napi_status node_into_roc_f32(napi_env env, napi_value value, size_t index,
+                              float *out);
+napi_status node_into_roc_f64(napi_env env, napi_value value, size_t index,
+                              double *out);
+
+// Convert Roc return values into Node values, consuming them.
+napi_value roc_str_into_node(napi_env env, struct RocStr value);
+napi_value roc_bytes_into_node(napi_env env, struct RocBytes value);
+napi_value roc_bool_into_node(napi_env env, bool value);
+napi_value roc_unit_into_node(napi_env env, uint8_t value);
+napi_value roc_i8_into_node(napi_env env, int8_t value);
+napi_value roc_u8_into_node(napi_env env, uint8_t value);
+napi_value roc_i16_into_node(napi_env env, int16_t value);
+napi_value roc_u16_into_node(napi_env env, uint16_t value);
+napi_value roc_i32_into_node(napi_env env, int32_t value);
+napi_value roc_u32_into_node(napi_env env, uint32_t value);
+napi_value roc_i64_into_node(napi_env env, int64_t value);
+napi_value roc_u64_into_node(napi_env env, uint64_t value);
+#ifdef __SIZEOF_INT128__
+napi_value roc_i128_into_node(napi_env env, __int128 value);
+napi_value roc_u128_into_node(napi_env env, unsigned __int128 value);
+napi_value roc_dec_into_node(napi_env env, __int128 value);
+#endif
+napi_value roc_f32_into_node(napi_env env, float value);
+napi_value roc_f64_into_node(napi_env env, double value);
+
+// Records: the glue compiles a reader and a maker function for each record
+// type once (see create_record_functions), and converts records with them.
+// `field_names` has each function's record's field names, separated by spaces,
+// for when Node doesn't allow compiling them.
+napi_status create_record_functions(napi_env env, const char *const *sources,
+                                    const char *const *field_names,
+                                    uint32_t count, napi_ref *out);
+napi_status read_record_fields(napi_env env, napi_value functions,
+                               uint32_t reader, napi_value value, size_t index,
+                               napi_value *fields);
+napi_value make_record(napi_env env, napi_value functions, uint32_t maker,
+                       size_t count, const napi_value *fields);
+
+napi_status export_function(napi_env env, napi_value exports, const char *name,
+                            napi_callback callback);
+napi_status export_function_with_data(napi_env env, napi_value exports,
+                                      const char *name, napi_callback callback,
+                                      void *data);
+
+// Install the crash handlers (if they haven't been already) and set up the
+// addon's exports. If `call_roc` is NULL, there is no callRoc export; that's
+// the case for the shared runtime, which has no Roc code of its own.
+napi_value init_addon(napi_env env, napi_value exports, napi_callback call_roc);
+
+#endif
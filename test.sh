@@ -10,6 +10,12 @@ os_name=$(uname)
 script_dir=$(readlink -f "$(dirname "$0")")
 test_dir=$script_dir/tests
 
+# Tests that use profile-guided optimization have to be built on the machine they run on
+# (see build.js), so they run on the host rather than in Docker.
+function builds_natively {
+  grep -qs '"pgo"' "$1/options.json"
+}
+
 function run {
   ($1 && printf "\n✅ Passed: %s\n" "$1") || {
     printf "\n❗️Failed: %s\n" "$1"
@@ -28,6 +34,10 @@ if [ "$os_name" = "Linux" ]; then
         *"node_modules"*) continue;;
         esac
 
+        if builds_natively "$dir"; then
+            continue
+        fi
+
         printf "\n⭐️ Running cross-compiled test: %s\n\n" "$dir"
         run "node $dir/dist/output.js"
     done
@@ -76,7 +86,16 @@ else
         printf "\n⭐️ Cross-compiling test using roc-esbuild plugin with zig cc: %s\n\n" "$dir"
         run "node $test_dir/build.js $dir --cross-compile=linux-x64"
         run "npx tsc $dir/main.roc.d.ts" # Check that the generated .d.ts files worked
+
+        if builds_natively "$dir"; then
+            printf "\n⭐️ Running test built for this machine: %s\n\n" "$dir"
+            run "node $dir/dist/output.js"
+        fi
     done
+
+    # The Jest transformer builds when it runs rather than ahead of time, so test it here, where roc runs.
+    printf "\n⭐️ Testing the Jest transformer\n\n"
+    run "$script_dir/node_modules/.bin/ts-node $test_dir/jest-transformer.ts"
 fi
 
 if [ "$os_name" != "Linux" ]; then
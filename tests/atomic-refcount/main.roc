@@ -0,0 +1,7 @@
+app "main"
+    packages { pf: "platform/main.roc" }
+    imports []
+    provides [main] to pf
+
+main : Str -> Str
+main = \text -> Str.repeat text 3
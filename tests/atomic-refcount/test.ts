@@ -0,0 +1,42 @@
+import { callRoc, getAllocatorStats } from './main.roc'
+
+// This is built with the `atomicRefcount` option, so the bridge's refcounting is atomic and
+// its allocator bookkeeping takes a lock. Check that calls still give the right answers and
+// don't leak, and report what each call costs. To compare with the default build, run this
+// again without options.json. For a steadier number, set ROC_ESBUILD_BENCH_CALLS higher.
+const calls = Number(process.env.ROC_ESBUILD_BENCH_CALLS || 100000)
+
+const cases: { [name: string]: string } = {
+    "small strings": "hi",
+    // Big enough that Roc's answer is refcounted on the heap, so the bridge decrefs it.
+    "big strings": "This string is too big to be a small string. ".repeat(20),
+}
+
+for (const [name, text] of Object.entries(cases)) {
+    if (callRoc(text) !== text.repeat(3)) {
+        console.error("Roc returned the wrong answer for", text)
+        process.exit(1)
+    }
+
+    // Warm up, so that whatever gets allocated once is already there.
+    for (let i = 0; i < 1000; i++) {
+        callRoc(text)
+    }
+
+    const baseline = getAllocatorStats()
+    const start = process.hrtime.bigint()
+
+    for (let i = 0; i < calls; i++) {
+        callRoc(text)
+    }
+
+    const nsPerCall = Number(process.hrtime.bigint() - start) / calls
+    const stats = getAllocatorStats()
+
+    console.log(`${calls} calls with ${name}: ${nsPerCall.toFixed(0)}ns per call`)
+
+    if (stats.liveBytes !== baseline.liveBytes || stats.liveAllocations !== baseline.liveAllocations) {
+        console.error(`Roc allocations leaked: there were ${baseline.liveBytes} bytes in ${baseline.liveAllocations} allocations before, and ${stats.liveBytes} in ${stats.liveAllocations} after`)
+        process.exit(1)
+    }
+}
@@ -0,0 +1,8 @@
+app "main"
+    packages { pf: "platform/main.roc" }
+    imports []
+    provides [main] to pf
+
+main : U64, I128 -> I128
+main = \id, amount ->
+    Num.toI128 id + amount
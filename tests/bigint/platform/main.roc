@@ -0,0 +1,9 @@
+platform "typescript-interop"
+    requires {} { main : U64, I128 -> I128 }
+    exposes []
+    packages {}
+    imports []
+    provides [mainForHost]
+
+mainForHost : U64, I128 -> I128
+mainForHost = \id, amount -> main id amount
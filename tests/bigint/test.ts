@@ -0,0 +1,28 @@
+import { callRoc } from './main.roc'
+
+// Neither of these fits in a JavaScript number without losing precision.
+const id = 2n ** 64n - 1n
+const amount = -(2n ** 100n)
+const answer = callRoc(id, amount)
+
+if (answer !== id + amount) {
+    console.error("Roc returned the wrong answer:", answer, "instead of", id + amount)
+    process.exit(1)
+}
+
+console.log("Roc added these bigints exactly:", answer)
+
+// A U64 can't be negative, so this should throw rather than wrapping around.
+try {
+    callRoc(-1n, 0n)
+
+    // We should not have reached this point!
+    process.exit(1)
+}
+catch(err: any) {
+    if (!(err instanceof TypeError)) {
+        throw err
+    }
+
+    console.log("Passing a negative bigint for a U64 threw, as it should have:", err.message)
+}
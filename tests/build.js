@@ -0,0 +1,62 @@
+// Accepts a CLI arg for the directory of the test to run.
+const testDir = process.argv[2]
+
+// Accepts a CLI arg for whether to cross-compile
+const crossCompile = (process.argv[3] || "").startsWith("--cross-compile") ? process.argv[3].replace(/^--cross-compile=/, "") : undefined
+
+const path = require("path")
+const fs = require("fs")
+const esbuild = require("esbuild")
+const roc = require("roc-esbuild").default
+const { execSync } = require("child_process")
+
+const distDir = path.join(testDir, "dist")
+const outfile = path.join(distDir, "output.js")
+
+fs.rmSync(distDir, { recursive: true, force: true });
+fs.mkdirSync(distDir)
+
+// The plugin puts its build report in the metafile. Every .roc module the test imports should be
+// in it, with how long each step of its build took, and the size of the addon it built.
+function checkReport(report) {
+  const steps = ["roc build", "cc"]
+  const badModule = report.modules.find(({ totalMs, durationsMs, addonBytes }) =>
+    !steps.every((step) => step in durationsMs) ||
+    !Object.values(durationsMs).every((ms) => ms >= 0 && ms <= totalMs) ||
+    !(addonBytes > 0))
+
+  if (report.modules.length === 0 || badModule !== undefined) {
+    throw new Error(`The build report should have had the duration of each step (including ${steps.join(" and ")}) and the addon's size for every module, but it was ${JSON.stringify(report, null, 2)}`)
+  }
+}
+
+async function build() {
+  // A test can give the plugin options of its own (e.g. to turn on a build
+  // option it tests) in an options.json next to its test.ts.
+  const optionsPath = path.join(testDir, "options.json")
+  const testOptions = fs.existsSync(optionsPath) ? JSON.parse(fs.readFileSync(optionsPath, "utf8")) : undefined
+  // Profile-guided optimization runs its training script against the addon as it gets built,
+  // so a test that uses it gets built for (and run on) this machine instead.
+  const crossCompileOptions = crossCompile && !(testOptions && testOptions.pgo) ? { cc: ["zig", "cc"], target: crossCompile } : undefined
+  const pluginArg = testOptions || crossCompileOptions ? { ...testOptions, ...crossCompileOptions } : undefined;
+
+  await esbuild
+    .build({
+      entryPoints: [path.join(testDir, "test.ts")],
+      bundle: true,
+      outfile,
+      sourcemap: "inline",
+      platform: "node",
+      minifyWhitespace: true,
+      treeShaking: true,
+      plugins: [roc(pluginArg)],
+      metafile: true,
+    })
+    .then((result) => checkReport(result.metafile.roc))
+    .catch((err) => {
+      console.error(err)
+      process.exit(1)
+    });
+}
+
+build()
@@ -0,0 +1,20 @@
+app "main"
+    packages { pf: "platform/main.roc" }
+    imports []
+    provides [main, squares] to pf
+
+# The squares of 0 through 15, for looking up instead of computing.
+squares : List U8
+squares = List.range { start: At 0, end: Before 16 } |> List.map \n -> n * n
+
+# Add up the squares of the digits in the given text.
+main : Str -> U64
+main = \text ->
+    Str.toUtf8 text
+    |> List.walk 0 \total, byte ->
+        if byte < '0' then
+            total
+        else
+            when List.get squares (Num.toNat (byte - '0')) is
+                Ok square -> total + Num.toU64 square
+                Err OutOfBounds -> total
@@ -0,0 +1,14 @@
+platform "typescript-interop"
+    requires {} { main : Str -> U64, squares : List U8 }
+    exposes []
+    packages {}
+    imports []
+    provides [mainForHost, lookupTable]
+
+mainForHost : Str -> U64
+mainForHost = \text -> main text
+
+# A constant rather than a function, which TypeScript gets as a function of no
+# arguments. With the `inlineConstants` option, its value goes in the bundle.
+lookupTable : List U8
+lookupTable = squares
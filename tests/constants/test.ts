@@ -0,0 +1,18 @@
+import { callRoc, lookupTable } from './main.roc'
+
+const expected = Buffer.from(Array.from({ length: 16 }, (_, n) => n * n))
+const table = lookupTable()
+
+if (!expected.equals(table)) {
+    console.error("Roc returned the wrong lookup table:", table)
+    process.exit(1)
+}
+
+const total = callRoc("1234")
+
+if (total !== 30n) {
+    console.error("Roc returned the wrong total:", total)
+    process.exit(1)
+}
+
+console.log("Roc's lookup table came through as a constant:", table)
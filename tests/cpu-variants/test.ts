@@ -0,0 +1,38 @@
+import fs from 'fs'
+import path from 'path'
+import { callRoc } from './main.roc'
+
+// This is built with the `cpuVariants` option, so the bundle has the baseline addon and an
+// x86-64-v2 one, and the shim loads the v2 one on CPUs that have all of its features.
+const addons = fs.readdirSync(__dirname).filter((file) => file.endsWith(".node"))
+const variant = addons.find((file) => file.includes(".x86-64-v2"))
+const baseline = addons.find((file) => file !== variant)
+
+function fail(message: string, ...details: Array<unknown>) {
+    console.error(message, ...details)
+    process.exit(1)
+}
+
+if (addons.length !== 2 || variant === undefined) {
+    fail("Expected the baseline addon and an x86-64-v2 addon next to the bundle, but found", addons)
+}
+
+const answer = callRoc({ firstName: "Richard", lastName: "Feldman" })
+
+if (answer !== "TS says your first name is Richard and your last name is Feldman! 🎉") {
+    fail("Roc returned the wrong answer:", answer)
+}
+
+// The addon that got loaded is mapped into this process, so it shows up in /proc/self/maps.
+const x86_64_v2_features = ["cx16", "lahf_lm", "popcnt", "sse4_1", "sse4_2", "ssse3"]
+const flagsLine = fs.readFileSync("/proc/cpuinfo", "utf8").split("\n").find((line) => line.startsWith("flags")) || ""
+const flags = new Set(flagsLine.split(":").slice(1).join(":").trim().split(/\s+/))
+const expected = process.arch === "x64" && x86_64_v2_features.every((feature) => flags.has(feature)) ? variant : baseline
+const maps = fs.readFileSync("/proc/self/maps", "utf8")
+const loaded = addons.filter((file) => maps.includes(path.join(__dirname, file)))
+
+if (loaded.length !== 1 || loaded[0] !== expected) {
+    fail(`This CPU should have loaded ${expected}, but the addons loaded were`, loaded)
+}
+
+console.log(`Roc says the following, from ${loaded[0]}:`, answer)
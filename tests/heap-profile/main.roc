@@ -0,0 +1,11 @@
+app "main"
+    packages { pf: "platform/main.roc" }
+    imports []
+    provides [main] to pf
+
+main : List U64 -> U64
+main = \sizes ->
+    List.walk sizes 0 \total, size ->
+        # Summing the bytes makes Roc allocate them, rather than only their length.
+        List.repeat 1u8 (Num.toNat size)
+        |> List.walk total \sum, byte -> sum + Num.toU64 byte
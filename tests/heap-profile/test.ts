@@ -0,0 +1,76 @@
+import { callRoc, getHeapProfile, resetHeapProfile } from './main.roc'
+
+// This is built with the `heapProfile` option, sampling every 4096 bytes, so every one of these
+// allocations gets sampled, on top of being counted in the size histogram. Each is big enough
+// that its size class has nothing else in it (Roc adds a few bytes for the refcount, which
+// doesn't change its class).
+const mediumSize = 100_000 // 65536-131071
+const mediumCount = 5
+const largeSize = 3_000_000 // 2097152-4194303
+const largeCount = 3
+const sizes = Array(mediumCount).fill(mediumSize).concat(Array(largeCount).fill(largeSize))
+const totalSize = mediumSize * mediumCount + largeSize * largeCount
+
+function fail(message: string, ...details: Array<unknown>) {
+    console.error(message, ...details)
+    process.exit(1)
+}
+
+// Anything from before the test starts doesn't count.
+resetHeapProfile()
+
+const sum = callRoc<Array<number>, number>(sizes)
+
+if (sum !== totalSize) {
+    fail(`Summing the bytes of lists of ${sizes} gave ${sum} instead of ${totalSize}`)
+}
+
+// "sizes" has a header, then a line per size class: "min-max allocations bytes live_allocations live_bytes"
+const [header, ...rows] = getHeapProfile("sizes").trim().split("\n")
+
+if (header !== "size allocations bytes live_allocations live_bytes") {
+    fail("The size histogram's header was", header)
+}
+
+const sizeClasses = new Map(rows.map((row) => {
+    const [sizeClass, ...counts] = row.split(" ")
+
+    return [sizeClass, counts.map(Number)]
+}))
+
+for (const [sizeClass, size, count] of [["65536-131071", mediumSize, mediumCount], ["2097152-4194303", largeSize, largeCount]] as const) {
+    const [allocations, bytes, liveAllocations, liveBytes] = sizeClasses.get(sizeClass) || []
+
+    // The lists were all freed by the time the call returned.
+    if (allocations !== count || !(bytes >= size * count && bytes < (size + 64) * count) || liveAllocations !== 0 || liveBytes !== 0) {
+        fail(`Expected ${count} allocations of about ${size} bytes in the ${sizeClass} size class, none of them live, but the histogram was`, rows)
+    }
+}
+
+// "collapsed" has a "stack bytes" line per allocation site, and every list got sampled.
+const collapsed = getHeapProfile("collapsed").trim().split("\n")
+const badLine = collapsed.find((line) => !/^\S+;roc_alloc \d+$/.test(line))
+const sampledBytes = collapsed.reduce((total, line) => total + Number(line.split(" ")[1]), 0)
+
+if (badLine !== undefined || sampledBytes < totalSize) {
+    fail(`Expected "stack bytes" lines adding up to at least ${totalSize}, but the collapsed profile was`, collapsed)
+}
+
+// "pprof" starts with the totals, followed by a line per allocation site.
+const pprof = getHeapProfile("pprof").split("\n")
+const counts = String.raw`\d+: \d+ \[\d+: \d+\]`
+const sites = pprof.slice(1, pprof.indexOf(""))
+
+if (!new RegExp(`^heap profile: ${counts} @ heap_v2/4096$`).test(pprof[0]) || sites.length === 0 ||
+    !sites.every((site) => new RegExp(`^${counts} @ 0x[0-9a-f]+$`).test(site))) {
+    fail("This isn't a heap profile pprof can read:", pprof.slice(0, sites.length + 1))
+}
+
+// A reset forgets everything but what's still live.
+resetHeapProfile()
+
+if (getHeapProfile("sizes").trim().split("\n").slice(1).some((row) => !/^\S+ 0 0 /.test(row))) {
+    fail("After a reset, the size histogram should only have had live allocations, but it was", getHeapProfile("sizes"))
+}
+
+console.log(`Profiled ${sizes.length} lists of ${totalSize} bytes in all:\n${collapsed.join("\n")}`)
@@ -0,0 +1,14 @@
+app "main"
+    packages { pf: "platform/main.roc" }
+    imports [pf.Host.{ Task }]
+    provides [main] to pf
+
+# Total up the prices of the given fruits, looking up each one's price as
+# needed rather than being passed the whole price list.
+main : List Str -> Task U64
+main = \fruits ->
+    List.walk fruits (Host.succeed 0) \task, fruit ->
+        total <- Host.await task
+        price <- Host.await (Host.call "lookupPrice" fruit)
+
+        Host.succeed (total + price)
@@ -0,0 +1,34 @@
+import { callRoc } from './main.roc'
+
+const prices = new Map([["apple", 3], ["pear", 5], ["kiwi", 7]])
+const lookedUp: Array<string> = []
+
+const lookupPrice = (fruit: string) => {
+    lookedUp.push(fruit)
+
+    return prices.get(fruit)
+}
+
+const total = callRoc<Array<string>, number>(["apple", "kiwi"], { hostFunctions: { lookupPrice } })
+
+if (total !== 10 || lookedUp.join() !== "apple,kiwi") {
+    console.error("Roc returned the wrong answer:", total, "after looking up", lookedUp)
+    process.exit(1)
+}
+
+console.log("Roc added up the prices it looked up:", total)
+
+// If a host function throws, callRoc should throw the same exception.
+try {
+    callRoc(["apple"], { hostFunctions: { lookupPrice: () => { throw new RangeError("No prices today") } } })
+
+    // We should not have reached this point!
+    process.exit(1)
+}
+catch(err: any) {
+    if (!(err instanceof RangeError)) {
+        throw err
+    }
+
+    console.log("The host function's exception made it through Roc, as it should have:", err.message)
+}
@@ -0,0 +1,27 @@
+app "main"
+    packages { pf: "platform/main.roc" }
+    imports []
+    provides [main, biggest, squares, origin, banner, noise] to pf
+
+# Too big for a JavaScript number, so it comes through as a bigint.
+biggest : U64
+biggest = Num.maxU64
+
+# The squares of 0 through 15.
+squares : List U8
+squares = List.range { start: At 0, end: Before 16 } |> List.map \n -> n * n
+
+origin : { x : F64, label : Str }
+origin = { x: 1.5, label: "origin-ish" }
+
+# These two are over the test's maxInlineBytes, so they go in files of their own.
+banner : Str
+banner = Str.repeat "Roc constants! " 100
+
+noise : List U8
+noise = List.range { start: At 0, end: Before 1000 } |> List.map \n -> Num.toU8 ((n * 7) % 256)
+
+# Add up the bytes of the given text.
+main : Str -> U64
+main = \text ->
+    Str.toUtf8 text |> List.walk 0 \total, byte -> total + Num.toU64 byte
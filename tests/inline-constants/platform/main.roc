@@ -0,0 +1,27 @@
+platform "typescript-interop"
+    requires {} { main : Str -> U64, biggest : U64, squares : List U8, origin : { x : F64, label : Str }, banner : Str, noise : List U8 }
+    exposes []
+    packages {}
+    imports []
+    provides [mainForHost, biggestNumber, lookupTable, originPoint, bannerText, noiseBytes]
+
+mainForHost : Str -> U64
+mainForHost = \text -> main text
+
+# Constants, which TypeScript gets as functions of no arguments. This test is
+# built with the `inlineConstants` option, so their values go in the bundle
+# (or, for bannerText and noiseBytes, in files next to it).
+biggestNumber : U64
+biggestNumber = biggest
+
+lookupTable : List U8
+lookupTable = squares
+
+originPoint : { x : F64, label : Str }
+originPoint = origin
+
+bannerText : Str
+bannerText = banner
+
+noiseBytes : List U8
+noiseBytes = noise
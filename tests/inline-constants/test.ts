@@ -0,0 +1,44 @@
+import { performance } from 'perf_hooks'
+import { isDeepStrictEqual } from 'util'
+import { bannerText, biggestNumber, callRoc, lookupTable, noiseBytes, originPoint } from './main.roc'
+
+// This is built with the `inlineConstants` option, so the constants' values were worked out at
+// build time, and calling them mustn't load the addon (which the shim records as a measure).
+function expect(name: string, actual: unknown, expected: unknown) {
+    if (!isDeepStrictEqual(actual, expected)) {
+        console.error(`Roc's ${name} was`, actual, "but it should have been", expected)
+        process.exit(1)
+    }
+}
+
+function addonLoaded() {
+    return performance.getEntriesByType("measure").some((entry) => entry.name.startsWith("roc-esbuild load"))
+}
+
+expect("biggestNumber", biggestNumber(), 18446744073709551615n)
+expect("lookupTable", lookupTable(), Buffer.from(Array.from({ length: 16 }, (_, n) => n * n)))
+expect("originPoint", originPoint(), { x: 1.5, label: "origin-ish" })
+
+// These two are bigger than maxInlineBytes, so they get read from files next to the bundle.
+expect("bannerText", bannerText(), "Roc constants! ".repeat(100))
+expect("noiseBytes", noiseBytes(), Buffer.from(Array.from({ length: 1000 }, (_, n) => (n * 7) % 256)))
+
+// Each call gets a Buffer of its own, so changing one doesn't change the constant.
+lookupTable()[0] = 99
+noiseBytes()[0] = 99
+expect("lookupTable after changing a copy", lookupTable()[0], 0)
+expect("noiseBytes after changing a copy", noiseBytes()[0], 0)
+
+if (addonLoaded()) {
+    console.error("Calling constants loaded the addon, so they weren't inlined")
+    process.exit(1)
+}
+
+expect("total", callRoc("abc"), 294n)
+
+if (!addonLoaded()) {
+    console.error("Calling a function didn't load the addon")
+    process.exit(1)
+}
+
+console.log("Roc's constants came through without loading the addon:", originPoint())
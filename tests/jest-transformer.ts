@@ -0,0 +1,91 @@
+// Tests the Jest transformer the way Jest uses it, outside of Jest. Unlike the tests in the
+// directories here, this builds its addon when it runs, so run it (with ts-node) wherever roc does.
+import fs from "fs"
+import os from "os"
+import path from "path"
+
+const Module = require("module")
+const transformer = require("../src/jest-transformer")
+
+function fail(message: string, ...details: Array<unknown>) {
+  console.error(message, ...details)
+  process.exit(1)
+}
+
+// Work on a copy of the json test, since building writes to the module's directory, and this
+// changes its platform.
+const workDir = fs.mkdtempSync(path.join(os.tmpdir(), "roc-esbuild-jest-"))
+const moduleDir = path.join(workDir, "module")
+const cacheDirectory = path.join(workDir, "cache")
+const cacheDir = path.join(cacheDirectory, "roc-esbuild")
+const options = { config: { cacheDirectory }, transformerConfig: {} }
+
+fs.cpSync(path.join(__dirname, "json"), moduleDir, {
+  recursive: true,
+  filter: (source) => !/\.(js|node|d\.ts)$/.test(source),
+})
+
+const rocFilePath = path.join(moduleDir, "main.roc")
+const platformPath = path.join(moduleDir, "platform", "main.roc")
+const transform = (sourcePath: string) => transformer.process(fs.readFileSync(sourcePath, "utf8"), sourcePath, options).code
+const addons = () =>
+  fs
+    .readdirSync(cacheDir)
+    .filter((file) => file.endsWith(".node"))
+    .map((file) => {
+      const { ino, mtimeMs } = fs.statSync(path.join(cacheDir, file))
+
+      return `${file} ${ino} ${mtimeMs}`
+    })
+    .sort()
+    .join("\n")
+const lockFiles = () => fs.readdirSync(cacheDir).filter((file) => file.endsWith(".lock"))
+
+try {
+  // The module it returns is the shim, which loads the addon from the cache.
+  const code = transform(rocFilePath)
+  const shim = new Module(rocFilePath)
+
+  shim._compile(code, rocFilePath)
+
+  const answer = shim.exports.callRoc({ firstName: "Richard", lastName: "Feldman" })
+
+  if (answer !== "TS says your first name is Richard and your last name is Feldman! 🎉") {
+    fail("The transformed module returned", answer)
+  }
+
+  // Transforming it again (e.g. in another Jest worker, or on the next run) reuses that build.
+  const built = addons()
+
+  if (built === "" || transform(rocFilePath) !== code || addons() !== built) {
+    fail("Transforming an unchanged module rebuilt it. Before:\n" + built + "\nAfter:\n" + addons())
+  }
+
+  // Changing the platform changes the cache key, so Jest doesn't reuse the old module.
+  const key = transformer.getCacheKey("", rocFilePath, options)
+
+  fs.appendFileSync(platformPath, "\n# A change to the platform\n")
+
+  if (transformer.getCacheKey("", rocFilePath, options) === key) {
+    fail("Changing the platform's main.roc didn't change the cache key", key)
+  }
+
+  // A build that fails doesn't leave its lock behind for the next one to wait on.
+  const brokenPath = path.join(workDir, "broken", "main.roc")
+
+  fs.mkdirSync(path.dirname(brokenPath))
+  fs.writeFileSync(brokenPath, "app \"broken\"\n    packages { pf: \"platform/main.roc\" }\n")
+
+  try {
+    transform(brokenPath)
+    fail("Transforming a module without a platform should have failed")
+  } catch (err) {
+    if (lockFiles().length !== 0) {
+      fail("A failed build left its lock file behind:", lockFiles())
+    }
+  }
+
+  console.log("The Jest transformer reused its build, and cleaned up after a failed one.")
+} finally {
+  fs.rmSync(workDir, { recursive: true, force: true })
+}
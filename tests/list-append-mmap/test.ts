@@ -0,0 +1,26 @@
+import { callRoc, getAllocatorStats } from './main.roc'
+
+// This is built with a 64KiB `mmapThreshold` and `hugePages`, so once the list outgrows 64KiB it
+// gets its own mapping, which roc_realloc then grows with mremap (into huge pages, once it's
+// 2MiB or more). Everything gets unmapped again when Roc frees it.
+const baseline = getAllocatorStats()
+
+for (const count of [1_000, 100_000, 1_000_000, 10_000_000]) {
+    const start = process.hrtime.bigint()
+    const sum = callRoc<number, number>(count)
+    const elapsedMs = Number(process.hrtime.bigint() - start) / 1e6
+    const expected = (count * (count - 1)) / 2
+    const stats = getAllocatorStats()
+
+    if (sum !== expected) {
+        console.error(`Appending ${count} numbers summed to ${sum} instead of ${expected}`)
+        process.exit(1)
+    }
+
+    if (stats.liveBytes !== baseline.liveBytes || stats.liveAllocations !== baseline.liveAllocations) {
+        console.error(`Appending ${count} numbers leaked: there were ${baseline.liveBytes} bytes in ${baseline.liveAllocations} allocations before, and ${stats.liveBytes} in ${stats.liveAllocations} after`)
+        process.exit(1)
+    }
+
+    console.log(`Appended ${count} numbers in ${elapsedMs.toFixed(2)}ms`)
+}
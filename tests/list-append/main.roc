@@ -0,0 +1,18 @@
+app "main"
+    packages { pf: "platform/main.roc" }
+    imports []
+    provides [main] to pf
+
+main : U64 -> U64
+main = \count ->
+    appendAll [] 0 count
+    |> List.walk 0 Num.add
+
+# Grow a list one element at a time, so that the list gets reallocated over
+# and over as it outgrows its capacity.
+appendAll : List U64, U64, U64 -> List U64
+appendAll = \list, next, count ->
+    if next == count then
+        list
+    else
+        appendAll (List.append list next) (next + 1) count
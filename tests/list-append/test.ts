@@ -0,0 +1,17 @@
+import { callRoc } from './main.roc'
+
+// Appending to a list in a loop exercises roc_realloc growing the same buffer
+// over and over, so this doubles as a benchmark of that.
+for (const count of [1_000, 100_000, 1_000_000, 10_000_000]) {
+    const start = process.hrtime.bigint()
+    const sum = callRoc<number, number>(count)
+    const elapsedMs = Number(process.hrtime.bigint() - start) / 1e6
+    const expected = (count * (count - 1)) / 2
+
+    if (sum !== expected) {
+        console.error(`Appending ${count} numbers summed to ${sum} instead of ${expected}`)
+        process.exit(1)
+    }
+
+    console.log(`Appended ${count} numbers in ${elapsedMs.toFixed(2)}ms`)
+}
@@ -0,0 +1,16 @@
+import { callRoc } from './main.roc'
+
+// This is built with `lto` and `pgo`, so the addon was linked with link-time optimization, using
+// the profile from running train.cjs. That has to run on the machine the addon is for, so unlike
+// the other tests, this one doesn't get cross-compiled.
+for (const [firstName, lastName] of [["Richard", "Feldman"], ["Ada", "Lovelace"], ["", ""]]) {
+    const answer = callRoc({ firstName, lastName })
+    const expected = `TS says your first name is ${firstName} and your last name is ${lastName}! 🎉`
+
+    if (answer !== expected) {
+        console.error("The optimized addon returned", answer, "but it should have returned", expected)
+        process.exit(1)
+    }
+}
+
+console.log("The addon built with lto and pgo gave the right answers.")
@@ -0,0 +1,7 @@
+// The pgo training script: build-roc runs this against the instrumented addon, whose path it
+// gets from ROC_ESBUILD_PGO_ADDON, to collect the profile the final addon gets optimized with.
+const addon = require(process.env.ROC_ESBUILD_PGO_ADDON)
+
+for (let i = 0; i < 1000; i++) {
+    addon.callRoc({ firstName: `Richard ${i}`, lastName: "Feldman" })
+}
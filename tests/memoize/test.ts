@@ -0,0 +1,70 @@
+import { callRoc, clearMemo, getMemoStats } from './main.roc'
+
+function expectStats(expected: Partial<ReturnType<typeof getMemoStats>>, when: string) {
+    const stats = getMemoStats()
+
+    for (const [name, value] of Object.entries(expected)) {
+        if (stats[name as keyof typeof stats] !== value) {
+            console.error(`After ${when}, expected ${name} to be ${value}, but the stats were:`, stats)
+            process.exit(1)
+        }
+    }
+}
+
+function expectAnswer(text: string) {
+    const answer = callRoc(text)
+
+    if (answer !== text.repeat(3)) {
+        console.error("Roc returned the wrong answer for", text, ":", answer)
+        process.exit(1)
+    }
+}
+
+expectAnswer("a")
+expectStats({ hits: 0, misses: 1, evictions: 0, entries: 1 }, "the first call")
+
+// The same argument again should come from the cache.
+expectAnswer("a")
+expectStats({ hits: 1, misses: 1, evictions: 0, entries: 1 }, "repeating the first call")
+
+// The cache holds 2 entries, so a third evicts the least recently used one.
+expectAnswer("b")
+expectAnswer("c")
+expectStats({ hits: 1, misses: 3, evictions: 1, entries: 2 }, "filling the cache")
+
+expectAnswer("a")
+expectStats({ hits: 1, misses: 4, evictions: 2, entries: 2 }, "calling with an evicted argument")
+
+// An answer bigger than maxBytes never gets cached (or evicts anything).
+const big = "x".repeat(3000)
+
+expectAnswer(big)
+expectAnswer(big)
+expectStats({ hits: 1, misses: 6, evictions: 2, entries: 2 }, "calling with an answer over maxBytes")
+
+if (getMemoStats().bytes > 4096) {
+    console.error("The cache holds more than maxBytes:", getMemoStats())
+    process.exit(1)
+}
+
+// Invalid options should throw even when the answer is cached.
+try {
+    callRoc("a", { timeoutMs: -1 })
+
+    // We should not have reached this point!
+    process.exit(1)
+}
+catch(err: any) {
+    if (!(err instanceof TypeError)) {
+        throw err
+    }
+}
+
+// Clearing the cache empties it, but keeps counting.
+clearMemo()
+expectStats({ hits: 1, misses: 6, evictions: 2, entries: 0, bytes: 0 }, "clearMemo")
+
+expectAnswer("a")
+expectStats({ hits: 1, misses: 7, entries: 1 }, "calling after clearMemo")
+
+console.log("Memoization works:", getMemoStats())
@@ -0,0 +1,8 @@
+app "main"
+    packages { pf: "platform/main.roc" }
+    imports []
+    provides [main] to pf
+
+main : { id : U32, name : Str, email : Str, city : Str, country : Str, active : Bool, score : F64, latitude : F64, longitude : F64, visits : U32, balance : F64, note : Str } -> { id : U32, name : Str, email : Str, city : Str, country : Str, active : Bool, score : F64, latitude : F64, longitude : F64, visits : U32, balance : F64, note : Str }
+main = \user ->
+    { user & visits: user.visits + 1, score: user.score * 2 }
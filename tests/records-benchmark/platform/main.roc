@@ -0,0 +1,11 @@
+platform "typescript-interop"
+    requires {} { main : { id : U32, name : Str, email : Str, city : Str, country : Str, active : Bool, score : F64, latitude : F64, longitude : F64, visits : U32, balance : F64, note : Str } -> { id : U32, name : Str, email : Str, city : Str, country : Str, active : Bool, score : F64, latitude : F64, longitude : F64, visits : U32, balance : F64, note : Str } }
+    exposes []
+    packages {}
+    imports []
+    provides [mainForHost]
+
+# The record gets passed to Roc as a C struct, converted field by field from
+# (and back into) a JavaScript object.
+mainForHost : { id : U32, name : Str, email : Str, city : Str, country : Str, active : Bool, score : F64, latitude : F64, longitude : F64, visits : U32, balance : F64, note : Str } -> { id : U32, name : Str, email : Str, city : Str, country : Str, active : Bool, score : F64, latitude : F64, longitude : F64, visits : U32, balance : F64, note : Str }
+mainForHost = \user -> main user
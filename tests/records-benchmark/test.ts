@@ -0,0 +1,62 @@
+import { spawnSync } from 'child_process'
+import { isDeepStrictEqual } from 'util'
+import { callRoc as callTyped } from './main.roc'
+import { callRoc as callJson } from './json/main.roc'
+
+// The same Roc function, built once with a platform that takes and returns a record (so the glue
+// converts it field by field) and once with a JSON platform, so this is a benchmark of the one
+// against the other.
+const user = {
+    id: 42,
+    name: "Richard Feldman",
+    email: "richard@example.com",
+    city: "Somewhere",
+    country: "Nowhere",
+    active: true,
+    score: 1.5,
+    latitude: 12.25,
+    longitude: -45.5,
+    visits: 7,
+    balance: 1234.5,
+    note: "A record with a dozen fields",
+}
+const expected = { ...user, visits: 8, score: 3 }
+const calls = 100_000
+
+// Without eval (see the end), the glue can't compile its functions for converting records, and
+// converts them through Node-API instead.
+const withoutEval = process.execArgv.includes("--disallow-code-generation-from-strings")
+const label = withoutEval ? " without eval" : ""
+
+for (const [name, call] of [["record", () => callTyped(user)], ["JSON", () => callJson<typeof user, typeof expected>(user)]] as const) {
+    const answer = call()
+
+    if (!isDeepStrictEqual(answer, expected)) {
+        console.error(`Passing the ${name}${label} returned`, answer, "but it should have returned", expected)
+        process.exit(1)
+    }
+
+    // Warm up, so that V8 has optimized whatever it's going to.
+    for (let i = 0; i < 1000; i++) {
+        call()
+    }
+
+    const start = process.hrtime.bigint()
+
+    for (let i = 0; i < calls; i++) {
+        call()
+    }
+
+    const nsPerCall = Number(process.hrtime.bigint() - start) / calls
+
+    console.log(`${calls} calls passing the ${name}${label}: ${nsPerCall.toFixed(0)}ns per call`)
+}
+
+if (!withoutEval) {
+    const child = spawnSync(process.execPath, ["--disallow-code-generation-from-strings", __filename], { stdio: "inherit" })
+
+    if (child.status !== 0) {
+        console.error("Passing records failed when Node didn't allow eval")
+        process.exit(1)
+    }
+}
@@ -0,0 +1,13 @@
+app "main"
+    packages { pf: "platform/main.roc" }
+    imports []
+    provides [main] to pf
+
+main : { name : Str, start : { x : F64, y : F64 }, steps : U32 } -> { greeting : Str, end : { x : F64, y : F64 } }
+main = \{ name, start, steps } ->
+    distance = Num.toF64 steps
+
+    {
+        greeting: "Hello, \(name)!",
+        end: { x: start.x + distance, y: start.y - distance },
+    }
@@ -0,0 +1,11 @@
+platform "typescript-interop"
+    requires {} { main : { name : Str, start : { x : F64, y : F64 }, steps : U32 } -> { greeting : Str, end : { x : F64, y : F64 } } }
+    exposes []
+    packages {}
+    imports []
+    provides [mainForHost]
+
+# Records get passed to Roc as C structs, converted field by field from (and
+# back into) JavaScript objects.
+mainForHost : { name : Str, start : { x : F64, y : F64 }, steps : U32 } -> { greeting : Str, end : { x : F64, y : F64 } }
+mainForHost = \input -> main input
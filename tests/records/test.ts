@@ -0,0 +1,26 @@
+import { callRoc } from './main.roc'
+
+const answer = callRoc({ name: "TypeScript", start: { x: 1.5, y: 2 }, steps: 3 })
+
+if (answer.greeting !== "Hello, TypeScript!" || answer.end.x !== 4.5 || answer.end.y !== -1) {
+    console.error("Roc returned the wrong answer:", answer)
+    process.exit(1)
+}
+
+console.log("Roc says the following:", answer)
+
+// A record that's missing a field should throw rather than reaching Roc.
+try {
+    // @ts-expect-error
+    callRoc({ name: "TypeScript", start: { x: 1.5 }, steps: 3 })
+
+    // We should not have reached this point!
+    process.exit(1)
+}
+catch(err: any) {
+    if (!(err instanceof TypeError)) {
+        throw err
+    }
+
+    console.log("Passing a record with a missing field threw, as it should have:", err.message)
+}
@@ -0,0 +1,8 @@
+app "greeting"
+    packages { pf: "platform/main.roc" }
+    imports []
+    provides [main] to pf
+
+main : { firstName : Str, lastName : Str } -> Str
+main = \{ firstName, lastName } ->
+    "Hello, \(firstName) \(lastName)!"
@@ -0,0 +1,11 @@
+app "main"
+    packages { pf: "platform/main.roc" }
+    imports []
+    provides [main] to pf
+
+main : Str -> Str
+main = \text ->
+    if text == "crash" then
+        crash "This is an intentional crash!"
+    else
+        Str.repeat text 2
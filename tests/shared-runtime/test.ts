@@ -0,0 +1,42 @@
+import fs from 'fs'
+import { callRoc as repeat } from './main.roc'
+import { callRoc as greet } from './greeting.roc'
+
+// This is built with the `sharedRuntime` option, so the two modules' addons both link against
+// one runtime addon, which holds the allocator and crash handling, rather than each having its own.
+const addons = fs.readdirSync(__dirname).filter((file) => file.endsWith(".node"))
+const runtimes = addons.filter((file) => file.startsWith("roc-esbuild-runtime"))
+
+if (runtimes.length !== 1 || addons.length !== 3) {
+    console.error("Expected one shared runtime and an addon for each of the 2 modules next to the bundle, but found", addons)
+    process.exit(1)
+}
+
+function expect(actual: unknown, expected: unknown) {
+    if (actual !== expected) {
+        console.error("Roc returned", actual, "but it should have returned", expected)
+        process.exit(1)
+    }
+}
+
+expect(repeat("ab"), "abab")
+expect(greet({ firstName: "Richard", lastName: "Feldman" }), "Hello, Richard Feldman!")
+
+// The runtime's crash handling recovers from one module crashing...
+try {
+    repeat("crash")
+
+    // We should not have reached this point!
+    process.exit(1)
+}
+catch(err: any) {
+    if (!(err instanceof Error) || !err.message.includes("This is an intentional crash!")) {
+        throw err
+    }
+}
+
+// ...and leaves both modules working afterwards.
+expect(greet({ firstName: "Ada", lastName: "Lovelace" }), "Hello, Ada Lovelace!")
+expect(repeat("cd"), "cdcd")
+
+console.log("Both modules ran on one shared runtime:", runtimes[0])
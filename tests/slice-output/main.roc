@@ -0,0 +1,9 @@
+app "main"
+    packages { pf: "platform/main.roc" }
+    imports []
+    provides [main] to pf
+
+main : Str -> Str
+main = \message ->
+    # Str.trim returns a seamless slice of `message` rather than copying it.
+    Str.trim message
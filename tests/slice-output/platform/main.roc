@@ -0,0 +1,20 @@
+platform "typescript-interop"
+    requires {} { main : arg -> ret where arg implements Decoding, ret implements Encoding }
+    exposes []
+    packages {}
+    imports [TotallyNotJson]
+    provides [mainForHost]
+
+mainForHost : List U8 -> List U8
+mainForHost = \json ->
+    when Decode.fromBytes json TotallyNotJson.json is
+        Ok arg ->
+            prefix = Str.toUtf8 "This prefix gets sliced off before returning to TypeScript: "
+
+            # Return a seamless slice into a bigger list, so the host has to
+            # account for the slice bit in the returned list's length.
+            prefix
+            |> List.concat (Encode.toBytes (main arg) TotallyNotJson.json)
+            |> List.dropFirst (List.len prefix)
+
+        Err _ -> crash "Roc received malformed JSON from TypeScript"
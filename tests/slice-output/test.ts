@@ -0,0 +1,11 @@
+import { callRoc } from './main.roc'
+
+const expected = "This string is long enough that Roc will not store it as a small string"
+const answer = callRoc(`    ${expected}    `)
+
+if (answer !== expected) {
+    console.log("Roc returned the wrong string from a seamless slice:", answer);
+    process.exit(1)
+}
+
+console.log("Roc returned the following seamless slice:", answer);
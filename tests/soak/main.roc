@@ -0,0 +1,13 @@
+app "main"
+    packages { pf: "platform/main.roc" }
+    imports []
+    provides [main] to pf
+
+main : { text : Str, times : U64, shouldCrash : Bool } -> { text : Str, length : U64 }
+main = \{ text, times, shouldCrash } ->
+    if shouldCrash then
+        crash "This is an intentional crash!"
+    else
+        repeated = Str.repeat text (Num.toNat times)
+
+        { text: repeated, length: Num.toU64 (Str.countUtf8Bytes repeated) }
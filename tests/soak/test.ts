@@ -0,0 +1,53 @@
+import { callRoc, getAllocatorStats } from './main.roc'
+
+// Call Roc over and over in each of these ways, and check that neither what Roc has
+// allocated nor the process's RSS grows, so that leaks (e.g. of the arguments the bridge
+// copies into Roc, or of what a crashed call allocated) get caught. For a longer soak, or
+// one under a sanitizer build (see the `sanitize` option), whose quarantine grows RSS on
+// purpose, set these environment variables.
+const calls = Number(process.env.ROC_ESBUILD_SOAK_CALLS || 100000)
+const maxRssGrowthMb = Number(process.env.ROC_ESBUILD_SOAK_MAX_RSS_GROWTH_MB || 64)
+const bigText = "This string is too big to be a small string. ".repeat(20)
+
+const cases: { [name: string]: () => void } = {
+    "small strings": () => { callRoc({ text: "hi", times: 1, shouldCrash: false }) },
+    "big strings": () => { callRoc({ text: bigText, times: 10, shouldCrash: false }) },
+    "crashes": () => {
+        try {
+            callRoc({ text: bigText, times: 1, shouldCrash: true })
+        } catch (err) {
+            return
+        }
+
+        console.log("Roc was supposed to crash, but it didn't!")
+        process.exit(1)
+    },
+}
+
+// Warm up, so that whatever gets allocated once (by Roc, V8, or the allocator) is already there.
+Object.values(cases).forEach((call) => { for (let i = 0; i < 1000; i++) call() })
+
+const baseline = getAllocatorStats()
+
+for (const [name, call] of Object.entries(cases)) {
+    const rssBefore = process.memoryUsage().rss
+
+    for (let i = 0; i < calls; i++) {
+        call()
+    }
+
+    const stats = getAllocatorStats()
+    const rssGrowthMb = (process.memoryUsage().rss - rssBefore) / 1024 / 1024
+
+    console.log(`${calls} calls with ${name}: ${stats.liveBytes} bytes in ${stats.liveAllocations} live Roc allocations, RSS grew ${rssGrowthMb.toFixed(1)}MB`)
+
+    if (stats.liveBytes !== baseline.liveBytes || stats.liveAllocations !== baseline.liveAllocations) {
+        console.log(`Roc allocations leaked: there were ${baseline.liveBytes} bytes in ${baseline.liveAllocations} allocations before`)
+        process.exit(1)
+    }
+
+    if (rssGrowthMb > maxRssGrowthMb) {
+        console.log(`RSS grew by more than ${maxRssGrowthMb}MB`)
+        process.exit(1)
+    }
+}
@@ -0,0 +1,19 @@
+app "main"
+    packages { pf: "platform/main.roc" }
+    imports [pf.Host.{ Task }]
+    provides [main] to pf
+
+# Count up to `depth` by recursing that many levels deep, then have the host
+# function "check" look at the total.
+main : U64 -> Task U64
+main = \depth ->
+    Host.call "check" (List.sum (countUpTo depth))
+
+# The recursive call isn't in tail position, so this can't become a loop; it
+# really does take a stack frame per number.
+countUpTo : U64 -> List U64
+countUpTo = \n ->
+    if n == 0 then
+        []
+    else
+        List.append (countUpTo (n - 1)) n
@@ -0,0 +1,8 @@
+hosted Effect
+    exposes [Effect, after, map, always, forever, loop, hostCall]
+    imports []
+    generates Effect with [after, map, always, forever, loop]
+
+# node-to-roc.c implements this (as roc_fx_hostCall) by calling the function of
+# this name in callRoc's `hostFunctions` option, with JSON going both ways.
+hostCall : Str, List U8 -> Effect (List U8)
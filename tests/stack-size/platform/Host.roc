@@ -0,0 +1,33 @@
+interface Host
+    exposes [Task, succeed, await, call, toEffect]
+    imports [Effect.{ Effect }, TotallyNotJson]
+
+## Something Roc can do that may involve calling host functions, which produces an `a`.
+Task a := Effect a
+
+succeed : a -> Task a
+succeed = \a -> @Task (Effect.always a)
+
+await : Task a, (a -> Task b) -> Task b
+await = \@Task effect, toNext ->
+    next = Effect.after effect \a ->
+        when toNext a is
+            @Task nextEffect -> nextEffect
+
+    @Task next
+
+## Call the host function with the given name (passed to `callRoc` in its
+## `hostFunctions` option), giving it `arg` and decoding what it returns.
+call : Str, arg -> Task ret where arg implements Encoding, ret implements Decoding
+call = \name, arg ->
+    effect =
+        Effect.hostCall name (Encode.toBytes arg TotallyNotJson.json)
+        |> Effect.map \bytes ->
+            when Decode.fromBytes bytes TotallyNotJson.json is
+                Ok ret -> ret
+                Err _ -> crash "Roc received malformed JSON from the host function \(name)"
+
+    @Task effect
+
+toEffect : Task a -> Effect a
+toEffect = \@Task effect -> effect
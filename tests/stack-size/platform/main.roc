@@ -0,0 +1,17 @@
+platform "typescript-interop"
+    requires {} { main : arg -> Task ret where arg implements Decoding, ret implements Encoding }
+    exposes [Host]
+    packages {}
+    imports [Host.{ Task }, Effect.{ Effect }, TotallyNotJson]
+    provides [mainForHost]
+
+# Because this returns an Effect, Roc can call back into TypeScript (through
+# Host.call) while it runs, rather than getting all its data up front.
+mainForHost : List U8 -> Effect (List U8)
+mainForHost = \json ->
+    when Decode.fromBytes json TotallyNotJson.json is
+        Ok arg ->
+            Host.toEffect (main arg)
+            |> Effect.map \ret -> Encode.toBytes ret TotallyNotJson.json
+
+        Err _ -> crash "Roc received malformed JSON from TypeScript"
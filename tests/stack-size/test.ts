@@ -0,0 +1,81 @@
+import { spawnSync } from 'child_process'
+import { callRoc } from './main.roc'
+
+// When this test runs itself as a child process (see the end), have the host function crash the
+// way a native module it called might.
+if (process.env.ROC_ESBUILD_TEST_HOST_CRASH !== undefined) {
+    callRoc(10, { hostFunctions: { check: () => process.kill(process.pid, "SIGBUS") } })
+
+    // The signal should have taken the process down before we got here.
+    process.exit(0)
+}
+
+// options.json gives Roc a 256MB stack of its own, so it can recurse far deeper than the few
+// megabytes of Node's main thread would allow. Roc still calls host functions on this thread.
+const depth = 1000000
+const checked: Array<number> = []
+const check = (total: number) => {
+    checked.push(total)
+
+    return total
+}
+
+const total = callRoc<number, number>(depth, { hostFunctions: { check } })
+
+if (total !== depth * (depth + 1) / 2 || checked.length !== 1) {
+    console.error("Roc returned the wrong answer:", total, "after checking", checked)
+    process.exit(1)
+}
+
+console.log(`Roc recursed ${depth} levels deep and added up`, total)
+
+// An exception from a host function still makes it back through Roc's thread.
+try {
+    callRoc(10, { hostFunctions: { check: () => { throw new RangeError("Nothing to check") } } })
+
+    // We should not have reached this point!
+    process.exit(1)
+}
+catch(err: any) {
+    if (!(err instanceof RangeError)) {
+        throw err
+    }
+
+    console.log("The host function's exception made it through Roc, as it should have:", err.message)
+}
+
+// Overflowing even that stack should throw rather than take down the process...
+try {
+    callRoc(100000000, { hostFunctions: { check } })
+
+    // We should not have reached this point!
+    process.exit(1)
+}
+catch(err: any) {
+    if (!(err instanceof Error) || !err.message.includes("while running `main`")) {
+        throw err
+    }
+
+    console.log("Overflowing Roc's stack threw, as it should have:", err.message)
+}
+
+// ...and leave Roc able to run again.
+if (callRoc<number, number>(3, { hostFunctions: { check } }) !== 6) {
+    console.error("Roc didn't work after overflowing its stack")
+    process.exit(1)
+}
+
+// A crash in a host function happens on this thread, not Roc's, so there's no recovering from
+// it the way we recover from Roc crashing: the process should die of it, as it would without Roc.
+// (Jumping back into Roc's thread from this one used to hang it, hence the timeout.)
+const child = spawnSync(process.execPath, [__filename], {
+    env: { ...process.env, ROC_ESBUILD_TEST_HOST_CRASH: "1" },
+    timeout: 60000,
+})
+
+if (child.signal !== "SIGBUS") {
+    console.error("A host function crashing should have killed the process with SIGBUS, but it exited with", child.status, child.signal, child.stderr.toString())
+    process.exit(1)
+}
+
+console.log("A host function crashing took down the process, as it should have")
@@ -0,0 +1,24 @@
+app "main"
+    packages { pf: "platform/main.roc" }
+    imports []
+    provides [init, step, done] { State } to pf
+
+# Count the separators in an input (e.g. the lines of an NDJSON file), and its
+# bytes, one chunk at a time.
+State : { separator : U8, count : U64, bytes : U64 }
+
+init : Str -> State
+init = \separator ->
+    when Str.toUtf8 separator is
+        [byte] -> { separator: byte, count: 0, bytes: 0 }
+        _ -> crash "The separator has to be a single byte"
+
+step : State, List U8 -> State
+step = \state, chunk ->
+    count = List.walk chunk state.count \total, byte ->
+        if byte == state.separator then total + 1 else total
+
+    { state & count: count, bytes: state.bytes + Num.toU64 (List.len chunk) }
+
+done : State -> { count : U64, bytes : U64 }
+done = \{ count, bytes } -> { count, bytes }
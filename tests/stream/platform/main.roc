@@ -0,0 +1,33 @@
+platform "typescript-interop"
+    requires { State } { init : Str -> State, step : State, List U8 -> State, done : State -> { count : U64, bytes : U64 } }
+    exposes []
+    packages {}
+    imports [TotallyNotJson]
+    provides [mainForHost, initForHost, stepForHost, doneForHost]
+
+# callRoc passes the whole input at once, so it all goes through one step.
+mainForHost : List U8 -> List U8
+mainForHost = \json ->
+    decoded : Result { separator : Str, text : Str } _
+    decoded = Decode.fromBytes json TotallyNotJson.json
+
+    when decoded is
+        Ok { separator, text } ->
+            Encode.toBytes (done (step (init separator) (Str.toUtf8 text))) TotallyNotJson.json
+
+        Err _ -> crash "Roc received malformed JSON from TypeScript"
+
+# streamRoc passes its argument to initForHost as JSON, then each chunk of its
+# input to stepForHost along with the state so far, and finally the last state
+# to doneForHost for its answer. In between, the host only holds on to the Box.
+initForHost : List U8 -> Box State
+initForHost = \json ->
+    when Decode.fromBytes json TotallyNotJson.json is
+        Ok separator -> Box.box (init separator)
+        Err _ -> crash "Roc received malformed JSON from TypeScript"
+
+stepForHost : Box State, List U8 -> Box State
+stepForHost = \state, chunk -> Box.box (step (Box.unbox state) chunk)
+
+doneForHost : Box State -> List U8
+doneForHost = \state -> Encode.toBytes (done (Box.unbox state)) TotallyNotJson.json
@@ -0,0 +1,108 @@
+import { Readable } from "stream"
+import { callRoc, streamRoc, getAllocatorStats, setMemoryLimit } from './main.roc'
+
+type Counts = { count: number; bytes: number }
+
+// Stream more than we'd want to pass to callRoc at once (about 60MB by default), and check
+// that Roc never has more than a chunk or so of it allocated along the way.
+const chunks = Number(process.env.ROC_ESBUILD_STREAM_CHUNKS || 1000)
+const line = "One more line of a file that's too big to pass to callRoc all at once.\n"
+const chunk = Buffer.from(line.repeat(1000))
+const maxLiveBytes = 4 * chunk.length
+
+function fail(...message: Array<any>) {
+    console.error(...message)
+    process.exit(1)
+}
+
+async function main() {
+    // callRoc takes the whole input, for comparison.
+    const oneChunk = callRoc<{ separator: string; text: string }, Counts>({ separator: "\n", text: chunk.toString() })
+
+    if (oneChunk.count !== 1000 || oneChunk.bytes !== chunk.length) {
+        fail("callRoc returned the wrong answer:", oneChunk)
+    }
+
+    const baseline = getAllocatorStats().liveBytes
+    let peak = 0
+
+    async function* input() {
+        for (let i = 0; i < chunks; i++) {
+            peak = Math.max(peak, getAllocatorStats().liveBytes - baseline)
+
+            yield chunk
+        }
+    }
+
+    const streamed = await streamRoc<string, Counts>(Readable.from(input()), "\n")
+
+    if (streamed.count !== chunks * 1000 || streamed.bytes !== chunks * chunk.length) {
+        fail("streamRoc returned the wrong answer:", streamed)
+    }
+
+    if (peak > maxLiveBytes) {
+        fail(`Roc had ${peak} bytes allocated part way through the stream, which is more than ${maxLiveBytes}`)
+    }
+
+    console.log(`Roc counted ${streamed.count} lines in ${streamed.bytes} bytes, with at most ${peak} bytes allocated at once`)
+
+    // Chunks don't have to line up with anything, and can be strings.
+    const text = "a,b,,c,".repeat(100)
+    const pieces = text.match(/[^]{1,13}/g) as Array<string>
+    const commas = await streamRoc<string, Counts>(pieces, ",")
+
+    if (commas.count !== 400 || commas.bytes !== text.length) {
+        fail("streamRoc returned the wrong answer for strings:", commas)
+    }
+
+    // If the input fails part way through, streamRoc rejects with its error, and Roc's state
+    // still gets freed.
+    async function* broken() {
+        yield chunk
+        throw new RangeError("The input broke")
+    }
+
+    try {
+        await streamRoc(broken(), "\n")
+        fail("streamRoc was supposed to reject, but it didn't!")
+    } catch (err: any) {
+        if (!(err instanceof RangeError)) {
+            throw err
+        }
+    }
+
+    if (getAllocatorStats().liveBytes !== baseline) {
+        fail("A stream whose input failed left Roc's state allocated:", getAllocatorStats())
+    }
+
+    // A chunk that doesn't fit within the memory limit rejects with a RangeError before it
+    // reaches Roc, and the state so far still gets freed.
+    setMemoryLimit(chunk.length / 2)
+
+    try {
+        await streamRoc([chunk], "\n")
+        fail("streamRoc was supposed to reject a chunk over the memory limit, but it didn't!")
+    } catch (err: any) {
+        if (!(err instanceof RangeError)) {
+            throw err
+        }
+
+        console.log("A chunk over the memory limit made streamRoc reject, as it should have:", err.message)
+    }
+
+    setMemoryLimit(0)
+
+    if (getAllocatorStats().liveBytes !== baseline) {
+        fail("A stream whose chunk was over the memory limit left Roc's state allocated:", getAllocatorStats())
+    }
+
+    // If Roc crashes, so does the stream.
+    try {
+        await streamRoc([chunk], "not one byte")
+        fail("Roc was supposed to crash, but it didn't!")
+    } catch (err: any) {
+        console.log("Roc crashed starting a stream, and streamRoc rejected, as it should have:", err.message)
+    }
+}
+
+main().catch((err) => fail(err))
@@ -0,0 +1,20 @@
+import fs from 'fs'
+import { callRoc } from './main.roc'
+
+// This is built with the `targets` option, so the bundle has an addon for each target, and the
+// shim loads the one for the machine it's running on.
+const addons = fs.readdirSync(__dirname).filter((file) => file.endsWith(".node"))
+
+if (addons.length !== 2) {
+    console.error("Expected an addon for each of the 2 targets next to the bundle, but found", addons)
+    process.exit(1)
+}
+
+const answer = callRoc({ firstName: "Richard", lastName: "Feldman" })
+
+if (answer !== "TS says your first name is Richard and your last name is Feldman! 🎉") {
+    console.error(`The ${process.platform}-${process.arch} addon returned the wrong answer:`, answer)
+    process.exit(1)
+}
+
+console.log(`Roc says the following, from the ${process.platform}-${process.arch} addon out of ${addons.join(", ")}:`, answer)
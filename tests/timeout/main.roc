@@ -0,0 +1,17 @@
+app "main"
+    packages { pf: "platform/main.roc" }
+    imports []
+    provides [main] to pf
+
+main : Str -> Str
+main = \message ->
+    spinForever message
+
+# Tail-recursive, so for any non-empty message this compiles to a loop that
+# never allocates and never ends.
+spinForever : Str -> Str
+spinForever = \message ->
+    if Str.isEmpty message then
+        message
+    else
+        spinForever message
@@ -0,0 +1,29 @@
+import { callRoc } from './main.roc'
+
+try {
+    callRoc("Hello from TypeScript", { timeoutMs: 100 })
+
+    // We should not have reached this point!
+    process.exit(1)
+}
+catch(err: any) {
+    if (err.code !== "ERR_ROC_TIMEOUT") {
+        throw err
+    }
+
+    console.log("This is a test of Roc's timeouts, and we successfully interrupted this Roc call:", err);
+}
+
+// A timed-out call must not break later calls.
+try {
+    callRoc("Hello again from TypeScript", { cpuTimeoutMs: 100 })
+
+    process.exit(1)
+}
+catch(err: any) {
+    if (err.code !== "ERR_ROC_TIMEOUT") {
+        throw err
+    }
+
+    console.log("We also interrupted this Roc call on its CPU time limit:", err);
+}
@@ -0,0 +1,72 @@
+import fs from 'fs'
+import path from 'path'
+import { callRoc, drainTraceEvents } from './main.roc'
+
+// This is built with the `trace` option and room for 16 events, so each call's phases get
+// recorded, and the oldest get dropped once more than 16 pile up between drains.
+const perCall = ["JSON.stringify", "argument into Roc", "Roc", "answer from Roc", "JSON.parse"]
+const arg = { firstName: "Richard", lastName: "Feldman" }
+
+function fail(message: string, ...details: Array<unknown>) {
+    console.error(message, ...details)
+    process.exit(1)
+}
+
+// Anything from before the test starts doesn't count.
+drainTraceEvents()
+
+callRoc(arg)
+
+const oneCall = drainTraceEvents()
+const names = oneCall.events.map((event) => event.name)
+
+if (oneCall.dropped !== 0 || names.join() !== perCall.join()) {
+    fail("One call should have recorded its phases in order, but drainTraceEvents returned", oneCall)
+}
+
+oneCall.events.forEach((event, index) => {
+    const previous = oneCall.events[index - 1]
+
+    if (event.cat !== "roc" || event.ph !== "X" || event.pid !== process.pid || !(event.dur >= 0) ||
+        (previous !== undefined && event.ts < previous.ts)) {
+        fail("This isn't a Chrome trace event that follows the one before it:", event, previous)
+    }
+})
+
+// 10 calls make 50 events, so only the last 16 are left.
+for (let i = 0; i < 10; i++) {
+    callRoc(arg)
+}
+
+const tenCalls = drainTraceEvents()
+const expectedNames = Array.from({ length: 10 }, () => perCall).flat().slice(-16)
+
+if (tenCalls.events.length !== 16 || tenCalls.dropped !== 34 ||
+    tenCalls.events.map((event) => event.name).join() !== expectedNames.join()) {
+    fail("After 10 calls, expected the last 16 events and 34 dropped, but drainTraceEvents returned", tenCalls)
+}
+
+const drained = drainTraceEvents()
+
+if (drained.events.length !== 0 || drained.dropped !== 0) {
+    fail("Draining again should have returned nothing new, but it returned", drained)
+}
+
+// The build steps went in a trace file next to main.roc (with the target in its name when
+// cross-compiling).
+const testDir = path.dirname(__dirname)
+const traceFile = fs.readdirSync(testDir).find((file) => /^main\.roc(\..+)?\.trace\.json$/.test(file))
+
+if (traceFile === undefined) {
+    fail("There's no build trace file in", testDir)
+}
+
+const buildSteps = JSON.parse(fs.readFileSync(path.join(testDir, traceFile as string), "utf8")).traceEvents.map((event: { name: string }) => event.name)
+
+for (const step of ["roc build", "cc", "build main.roc"]) {
+    if (!buildSteps.includes(step)) {
+        fail(`The build trace file ${traceFile} has no "${step}" step:`, buildSteps)
+    }
+}
+
+console.log("Roc's calls and build steps were traced:", tenCalls.events.slice(-perCall.length))
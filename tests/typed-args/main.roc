@@ -0,0 +1,8 @@
+app "main"
+    packages { pf: "platform/main.roc" }
+    imports []
+    provides [main] to pf
+
+main : Str, U32 -> Str
+main = \message, count ->
+    Str.repeat message (Num.toNat count)
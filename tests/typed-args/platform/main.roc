@@ -0,0 +1,11 @@
+platform "typescript-interop"
+    requires {} { main : Str, U32 -> Str }
+    exposes []
+    packages {}
+    imports []
+    provides [mainForHost]
+
+# Since this doesn't take and return JSON (List U8), roc-esbuild generates glue
+# that passes each argument to Roc as the type it's declared as here.
+mainForHost : Str, U32 -> Str
+mainForHost = \message, count -> main message count
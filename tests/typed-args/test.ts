@@ -0,0 +1,53 @@
+import { callRoc, getAllocatorStats, setMemoryLimit } from './main.roc'
+
+const answer = callRoc("Hello from TypeScript! ", 3)
+
+if (answer !== "Hello from TypeScript! ".repeat(3)) {
+    console.error("Roc returned the wrong answer:", answer)
+    process.exit(1)
+}
+
+console.log("Roc says the following:", answer)
+
+// Arguments outside their Roc type's range should throw rather than reaching
+// Roc. (A U32 is a `number` in TypeScript, so this type-checks.)
+try {
+    callRoc("Hello", -1)
+
+    // We should not have reached this point!
+    process.exit(1)
+}
+catch(err: any) {
+    if (!(err instanceof TypeError)) {
+        throw err
+    }
+
+    console.log("Passing a negative number for a U32 threw, as it should have:", err.message)
+}
+
+// An argument that doesn't fit within the memory limit should throw a
+// RangeError before Roc runs, and leave nothing allocated.
+const liveBytes = getAllocatorStats().liveBytes
+
+setMemoryLimit(1024)
+
+try {
+    callRoc("x".repeat(4096), 1)
+
+    // We should not have reached this point!
+    process.exit(1)
+}
+catch(err: any) {
+    if (!(err instanceof RangeError)) {
+        throw err
+    }
+
+    console.log("Passing a string over the memory limit threw, as it should have:", err.message)
+}
+
+setMemoryLimit(0)
+
+if (getAllocatorStats().liveBytes !== liveBytes) {
+    console.error("The argument that didn't fit was never freed")
+    process.exit(1)
+}